@@ -0,0 +1,58 @@
+#include "arena.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+Arena compile_arena;
+
+/****** Arena Implementation **************************************/
+
+Arena::Arena()
+{
+	m_blocks = NULL;
+	m_top = m_end = NULL;
+	m_allocated = 0;
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+void Arena::grow(size_t bytes)
+{
+	// the header is rounded up so the space after it stays aligned
+	size_t header = (sizeof(Block) + align - 1) & ~(align - 1);
+	size_t size = bytes + header > block_size ? bytes + header : block_size;
+	Block* b = (Block*)malloc(size);
+	if(b == NULL) throw std::bad_alloc();
+	b->next = m_blocks;
+	b->size = size;
+	m_blocks = b;
+	m_allocated += size;
+	m_top = (char*)b + header;
+	m_end = (char*)b + size;
+}
+
+char* Arena::strdup(const char* s)
+{
+	size_t n = strlen(s) + 1;
+	char* p = (char*)alloc(n);
+	memcpy(p, s, n);
+	return p;
+}
+
+void Arena::release()
+{
+	for(size_t i = m_finalizers.size(); i > 0; i--)
+		m_finalizers[i-1].first(m_finalizers[i-1].second);
+	m_finalizers.clear();
+
+	while(m_blocks != NULL) {
+		Block* next = m_blocks->next;
+		free(m_blocks);
+		m_blocks = next;
+	}
+	m_top = m_end = NULL;
+	m_allocated = 0;
+}
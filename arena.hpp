@@ -0,0 +1,114 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <list>
+#include <new>
+#include <vector>
+
+// A finished list's elements, copied into one stretch of the arena by
+// Arena::seal() so that walking them is a scan rather than a pointer chase
+template<class T> struct Items
+{
+	T* first;
+	size_t n;
+
+	T* begin() const { return first; }
+	T* end() const { return first + n; }
+	size_t size() const { return n; }
+	T& operator[](size_t k) const { return first[k]; }
+};
+
+// Memory for everything that lives as long as the compile: syntax tree
+// nodes, identifier strings and the lists that hold them. Allocation bumps a
+// pointer through large blocks, nothing is freed one object at a time, and
+// release() hands every block back at once.
+//
+// Arena memory never has its destructor run unless the object is registered
+// with owned(), which is only needed for objects that hold heap memory of
+// their own (std::list nodes, the vector in a method's Attribute).
+class Arena
+{
+  public:
+	Arena();
+	~Arena();
+
+	void* alloc(size_t bytes)
+	{
+		bytes = (bytes + align - 1) & ~(align - 1);
+		if(bytes > (size_t)(m_end - m_top)) grow(bytes);
+		void* p = m_top;
+		m_top += bytes;
+		return p;
+	}
+
+	char* strdup(const char* s);
+
+	// Run p's destructor when the arena is released
+	template<class T> T* owned(T* p)
+	{
+		m_finalizers.push_back(Finalizer(destroy<T>, p));
+		return p;
+	}
+
+	// An empty list that is cleared on release. The list's Items are kept
+	// in the words just before it, empty until the list is sealed.
+	template<class T> std::list<T>* new_list()
+	{
+		char* p = (char*)alloc(items_room + sizeof(std::list<T>));
+		new(p) Items<T>();
+		return owned(new(p + items_room) std::list<T>());
+	}
+
+	// Copy the elements of l, which came from new_list(), into its Items;
+	// the parser does this once it has built all of l
+	template<class T> std::list<T>* seal(std::list<T>* l)
+	{
+		Items<T>& a = items(l);
+		a.first = (T*)alloc(l->size() * sizeof(T));
+		a.n = 0;
+		for(typename std::list<T>::iterator i = l->begin(); i != l->end(); ++i) a.first[a.n++] = *i;
+		return l;
+	}
+
+	template<class T> static Items<T>& items(std::list<T>* l)
+	{
+		return *(Items<T>*)((char*)l - items_room);
+	}
+
+	// Destroy registered objects and give back every block
+	void release();
+
+	size_t allocated() const { return m_allocated; }
+
+  private:
+	static const size_t align = alignof(std::max_align_t);
+	static const size_t block_size = 64 * 1024;
+	static const size_t items_room = (sizeof(Items<void*>) + align - 1) & ~(align - 1);
+
+	struct Block
+	{
+		Block* next;
+		size_t size;
+	};
+	typedef std::pair<void (*)(void*), void*> Finalizer;
+
+	Block* m_blocks;
+	char* m_top;
+	char* m_end;
+	size_t m_allocated;
+	std::vector<Finalizer> m_finalizers;
+
+	void grow(size_t bytes);
+
+	template<class T> static void destroy(void* p) { static_cast<T*>(p)->~T(); }
+};
+
+// The arena the parser builds the syntax tree in
+extern Arena compile_arena;
+
+// new(arena) T(...) places a T in the arena
+inline void* operator new(size_t bytes, Arena &arena) { return arena.alloc(bytes); }
+inline void operator delete(void*, Arena &) {}
+
+#endif //ARENA_HPP
@@ -0,0 +1,53 @@
+#include "asmbuffer.hpp"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+
+/****** AsmBuffer Implementation **************************************/
+
+AsmBuffer::AsmBuffer(FILE* out)
+{
+	m_out = out;
+	m_buf = NULL;
+	m_len = 0;
+	m_instructions = 0;
+	m_stream = open_memstream(&m_buf, &m_len);
+	if(m_stream == NULL) m_stream = out; // no memory to buffer in, print straight through
+}
+
+AsmBuffer::~AsmBuffer()
+{
+	flush();
+}
+
+void AsmBuffer::flush()
+{
+	if(m_stream == NULL || m_stream == m_out) return;
+	fclose(m_stream);
+	m_stream = NULL;
+
+	// instructions are indented and start with their mnemonic
+	for(size_t i = 0; i < m_len; i++) {
+		if(i > 0 && m_buf[i-1] != '\n') continue;
+		size_t j = i;
+		while(j < m_len && (m_buf[j] == ' ' || m_buf[j] == '\t')) j++;
+		if(j > i && j < m_len && isalpha((unsigned char)m_buf[j])) m_instructions++;
+	}
+
+	// anything already printed to the file directly goes first
+	fflush(m_out);
+	int fd = fileno(m_out);
+	size_t done = 0;
+	while(done < m_len) {
+		ssize_t n = write(fd, m_buf + done, m_len - done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) {
+			perror("writing assembly");
+			break;
+		}
+		done += n;
+	}
+	free(m_buf);
+	m_buf = NULL;
+}
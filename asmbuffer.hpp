@@ -0,0 +1,32 @@
+#ifndef ASMBUFFER_HPP
+#define ASMBUFFER_HPP
+
+#include <stdio.h>
+
+// Collects a whole program's assembly in memory and hands it to the output
+// file in a single write. Codegen prints into stream() exactly as it would
+// into a FILE, so none of the instruction emitters have to change.
+class AsmBuffer
+{
+  public:
+	AsmBuffer(FILE* out);
+	~AsmBuffer();
+
+	FILE* stream() { return m_stream; }
+
+	// Write everything printed so far to the output file; the buffer is
+	// closed afterwards
+	void flush();
+
+	// Instructions written by flush, not counting labels, directives or comments
+	long instructions() const { return m_instructions; }
+
+  private:
+	FILE* m_out;
+	FILE* m_stream;
+	char* m_buf;
+	size_t m_len;
+	long m_instructions;
+};
+
+#endif //ASMBUFFER_HPP
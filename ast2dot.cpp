@@ -111,8 +111,8 @@ class Ast2dot : public Visitor {
  void visitNullPointer() { count++; add_edge(s.top(), count); add_null(count); }
 };
 
-void dopass_ast2dot(Program_ptr ast) {
-        Ast2dot* ast2dot = new Ast2dot(stdout); //create the visitor
+void dopass_ast2dot(Program_ptr ast, FILE* out) {
+        Ast2dot* ast2dot = new Ast2dot(out); //create the visitor
         ast->accept(ast2dot); //walk the tree with the visitor above
 	ast2dot->finish(); // finalize the printout
 	delete ast2dot;
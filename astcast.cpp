@@ -0,0 +1,56 @@
+#include "astcast.hpp"
+
+// Records which kind of expression accepted it; nothing else ever accepts
+// it, so the other visits are never called
+class ExprKindVisitor : public Visitor {
+ public:
+ ExprKind kind;
+
+ void visitProgramImpl(ProgramImpl *p) { assert(0); }
+ void visitClassImpl(ClassImpl *p) { assert(0); }
+ void visitDeclarationImpl(DeclarationImpl *p) { assert(0); }
+ void visitMethodImpl(MethodImpl *p) { assert(0); }
+ void visitMethodBodyImpl(MethodBodyImpl *p) { assert(0); }
+ void visitParameterImpl(ParameterImpl *p) { assert(0); }
+ void visitAssignment(Assignment *p) { assert(0); }
+ void visitIf(If *p) { assert(0); }
+ void visitPrint(Print *p) { assert(0); }
+ void visitReturnImpl(ReturnImpl *p) { assert(0); }
+ void visitTInteger(TInteger *p) { assert(0); }
+ void visitTBoolean(TBoolean *p) { assert(0); }
+ void visitTNothing(TNothing *p) { assert(0); }
+ void visitTObject(TObject *p) { assert(0); }
+ void visitClassIDImpl(ClassIDImpl *p) { assert(0); }
+ void visitVariableIDImpl(VariableIDImpl *p) { assert(0); }
+ void visitMethodIDImpl(MethodIDImpl *p) { assert(0); }
+ void visitPlus(Plus *p) { kind = ek_plus; }
+ void visitMinus(Minus *p) { kind = ek_minus; }
+ void visitTimes(Times *p) { kind = ek_times; }
+ void visitDivide(Divide *p) { kind = ek_divide; }
+ void visitAnd(And *p) { kind = ek_and; }
+ void visitLessThan(LessThan *p) { kind = ek_lessthan; }
+ void visitLessThanEqualTo(LessThanEqualTo *p) { kind = ek_lessthanequalto; }
+ void visitNot(Not *p) { kind = ek_not; }
+ void visitUnaryMinus(UnaryMinus *p) { kind = ek_unaryminus; }
+ void visitMethodCall(MethodCall *p) { kind = ek_methodcall; }
+ void visitSelfCall(SelfCall *p) { kind = ek_selfcall; }
+ void visitVariable(Variable *p) { kind = ek_variable; }
+ void visitIntegerLiteral(IntegerLiteral *p) { kind = ek_integerliteral; }
+ void visitBooleanLiteral(BooleanLiteral *p) { kind = ek_booleanliteral; }
+ void visitNothing(Nothing *p) { kind = ek_nothing; }
+
+ //special cases
+ void visitSymName(SymName *p) { assert(0); }
+ void visitPrimitive(Primitive *p) { assert(0); }
+ void visitClassName(ClassName *p) { assert(0); }
+
+ //very special case
+ void visitNullPointer() { assert(0); }
+};
+
+ExprKind expr_kind(Expression* e)
+{
+	ExprKindVisitor v;
+	e->accept(&v);
+	return v.kind;
+}
@@ -0,0 +1,93 @@
+#ifndef ASTCAST_HPP
+#define ASTCAST_HPP
+
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "classhierarchy.hpp"
+#include "arena.hpp"
+#include <assert.h>
+
+// Getting from a syntax tree node to its concrete type without RTTI.
+//
+// ClassID, VariableID, MethodID and the other node types the grammar
+// gives a single concrete class can only ever be that class, so ast_cast
+// is a static_cast. Building with -DCHECK_AST_CASTS checks each one with
+// dynamic_cast anyway.
+//
+// Expressions come in many kinds, and passes that pattern match on their
+// children use expr_cast, which asks the node for its kind through its
+// accept() and returns NULL when it is some other kind.
+
+template<class T, class B> inline T* ast_cast(B* p)
+{
+#ifdef CHECK_AST_CASTS
+	assert(p == NULL || dynamic_cast<T*>(p) != NULL);
+#endif
+	return static_cast<T*>(p);
+}
+
+// The children in a list member of a node, as the array the parser sealed
+// them into. The hot passes walk these; the std::list itself is left for the
+// generated visit_children() and clone(), so a pass that rewrites the array
+// copies it back with store_items().
+template<class T> inline Items<T>& items_of(std::list<T>* l)
+{
+#ifdef CHECK_AST_CASTS
+	assert(Arena::items(l).size() == l->size());
+#endif
+	return Arena::items(l);
+}
+
+template<class T> inline void store_items(std::list<T>* l)
+{
+	Items<T>& a = Arena::items(l);
+	l->assign(a.begin(), a.end());
+}
+
+// Visit each child in a list member, in order
+template<class T> inline void visit_items(std::list<T>* l, Visitor* v)
+{
+	Items<T>& a = items_of(l);
+	for(size_t k = 0; k < a.size(); k++) a[k]->accept(v);
+}
+
+inline SymName* symname_of(VariableID* p) { return ast_cast<VariableIDImpl>(p)->m_symname; }
+inline SymName* symname_of(MethodID* p) { return ast_cast<MethodIDImpl>(p)->m_symname; }
+inline ClassName* classname_of(ClassID* p) { return ast_cast<ClassIDImpl>(p)->m_classname; }
+
+enum ExprKind
+{
+	ek_plus, ek_minus, ek_times, ek_divide, ek_and, ek_lessthan,
+	ek_lessthanequalto, ek_not, ek_unaryminus, ek_methodcall, ek_selfcall,
+	ek_variable, ek_integerliteral, ek_booleanliteral, ek_nothing
+};
+
+ExprKind expr_kind(Expression* e);
+
+template<class T> struct ExprKindOf;
+#define EXPR_KIND(T, k) template<> struct ExprKindOf<T> { static const ExprKind kind = k; };
+EXPR_KIND(Plus, ek_plus)
+EXPR_KIND(Minus, ek_minus)
+EXPR_KIND(Times, ek_times)
+EXPR_KIND(Divide, ek_divide)
+EXPR_KIND(And, ek_and)
+EXPR_KIND(LessThan, ek_lessthan)
+EXPR_KIND(LessThanEqualTo, ek_lessthanequalto)
+EXPR_KIND(Not, ek_not)
+EXPR_KIND(UnaryMinus, ek_unaryminus)
+EXPR_KIND(MethodCall, ek_methodcall)
+EXPR_KIND(SelfCall, ek_selfcall)
+EXPR_KIND(Variable, ek_variable)
+EXPR_KIND(IntegerLiteral, ek_integerliteral)
+EXPR_KIND(BooleanLiteral, ek_booleanliteral)
+EXPR_KIND(Nothing, ek_nothing)
+#undef EXPR_KIND
+
+// e as a T, or NULL if e is some other kind of expression
+template<class T> inline T* expr_cast(Expression* e)
+{
+	if(e == NULL || expr_kind(e) != ExprKindOf<T>::kind) return NULL;
+	return ast_cast<T>(e);
+}
+
+#endif //ASTCAST_HPP
@@ -0,0 +1,79 @@
+# Generates a synthetic program of any size for the benchmarks:
+#
+#   awk -v classes=N -v methods=M -v depth=D -v seed=S -f bench/gen.awk > big.lang
+#
+# Each class extends the one before it and overrides every method, so
+# calls through the base class dispatch through vtables. Methods build long
+# expression chains, call the method defined just before them, and allocate
+# a temporary object. Program.start drives every class through a recursive
+# walk of the given depth. Only division by positive literals is used, so
+# any seed gives a program that runs to completion.
+
+function rnd(n) { return int(rand() * n) }
+
+function operand(c) {
+	k = rnd(4)
+	if(k == 0) return "x"
+	if(k == 1) return "r"
+	if(k == 2) return "v" c
+	return rnd(50) + 1
+}
+
+function chain(c, len,    s, i, k) {
+	s = operand(c)
+	for(i = 1; i < len; i++) {
+		k = rnd(4)
+		if(k == 0) s = s " + " operand(c)
+		else if(k == 1) s = s " - " operand(c)
+		else if(k == 2) s = s " * " operand(c)
+		else s = s " / " (rnd(9) + 1)
+	}
+	return s
+}
+
+BEGIN {
+	if(classes == "") classes = 10
+	if(methods == "") methods = 10
+	if(depth == "") depth = 12
+	srand(seed == "" ? 1 : seed)
+
+	print "/* generated by bench/gen.awk: classes=" classes " methods=" methods " depth=" depth " seed=" seed " */"
+	print "Temp {"
+	print "  t : Int;"
+	print "  put(k : Int) : Int {"
+	print "    t = t + k;"
+	print "    return t;"
+	print "  };"
+	print "};"
+
+	for(c = 0; c < classes; c++) {
+		print "C" c (c > 0 ? " from C" (c - 1) : "") " {"
+		print "  v" c " : Int;"
+		for(m = 0; m < methods; m++) {
+			print "  m" m "(x : Int) : Int {"
+			print "    r : Int;"
+			print "    o : Temp;"
+			print "    r = o.put(x);"
+			print "    r = " chain(c, 4 + rnd(12)) ";"
+			if(m > 0) print "    if " chain(c, 2) " < " chain(c, 2) " then r = r + m" (m - 1) "(x - 1) / 2;"
+			print "    v" c " = r / 4;"
+			print "    return r / 3;"
+			print "  };"
+		}
+		print "};"
+	}
+
+	print "Program {"
+	print "  walk(o : C0, n : Int) : Int {"
+	print "    r : Int;"
+	print "    r = o.m" (methods - 1) "(n);"
+	print "    if 1 < n then r = r / 2 + walk(o, n - 1) / 2 + walk(o, n - 2) / 2;"
+	print "    return r;"
+	print "  };"
+	print "  start() : Nothing {"
+	for(c = 0; c < classes; c++) print "    o" c " : C" c ";"
+	for(c = 0; c < classes; c++) print "    print walk(o" c ", " depth ");"
+	print "    return;"
+	print "  };"
+	print "};"
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# bench/lex.sh [file.lang...]  times the scanner on its own, in MB/s
+#
+# Run from the top of the tree, usually through `make bench-lex`. Scans the
+# files given, or else bench/*.lang followed by synthetic programs from
+# bench/gen.awk, one per size in SYNTH (classes x methods x depth), with
+# `lang --lex-only`. For each file it prints one tab-separated line:
+#
+#   program  bytes  tokens  lex_ms  mb_per_s
+#
+# lex_ms is the best of REPEAT runs of the scanner alone, as reported by
+# --time-report=json, so it leaves out starting the compiler and opening
+# the file. The corpus files are small; the synthetic ones are the ones to
+# compare between versions.
+
+LANGC=${LANGC:-./lang}
+REPEAT=${REPEAT:-5}
+SYNTH=${SYNTH:-"100x40x10 400x40x10"}
+OUT=bench/out
+
+# lex name file  prints the line for one file
+lex() {
+    best=""
+    i=0
+    while [ $i -lt $REPEAT ]; do
+        $LANGC --lex-only --time-report=json $2 2> $OUT/lex.json > /dev/null || { printf "%s\t-\t-\t-\t-\n" $1; return; }
+        best=$(awk -v best="$best" '/"name": "lex"/ {
+                   sub(/.*"seconds": /, ""); sub(/,.*/, ""); t = $0 * 1000
+                   if(best != "" && best < t) t = best
+                   printf "%.3f", t }' $OUT/lex.json)
+        i=$((i + 1))
+    done
+    tokens=$(sed -n 's/.*"tokens": \([0-9]*\).*/\1/p' $OUT/lex.json)
+    bytes=$(wc -c < $2)
+    echo "$1 $bytes $tokens $best" | awk -v OFS='\t' '{ print $1, $2, $3, $4, ($4 > 0 ? sprintf("%.1f", $2 / 1000 / $4) : "-") }'
+}
+
+mkdir -p $OUT
+printf "program\tbytes\ttokens\tlex_ms\tmb_per_s\n"
+if [ $# -gt 0 ]; then
+    for src in "$@"; do
+        lex $(basename $src .lang) $src
+    done
+    exit 0
+fi
+for src in bench/*.lang; do
+    lex $(basename $src .lang) $src
+done
+for size in $SYNTH; do
+    set -- $(echo $size | tr x ' ')
+    awk -v classes=$1 -v methods=$2 -v depth=$3 -v seed=1 -f bench/gen.awk > $OUT/synth_$size.lang
+    lex synth_$size $OUT/synth_$size.lang
+done
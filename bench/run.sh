@@ -0,0 +1,82 @@
+#!/bin/sh
+# bench/run.sh [lang options]  compiles and runs every benchmark program
+#
+# Run from the top of the tree, usually through `make bench`. The corpus in
+# bench/*.lang is followed by synthetic programs from bench/gen.awk, one per
+# size in SYNTH (classes x methods x depth). For each program it prints one
+# tab-separated line:
+#
+#   program  compile_ms  run_ms  asm_lines  output_cksum  status
+#
+# Times are the best of REPEAT runs. status is ok or FAIL when the output is
+# checked against bench/<program>.expected, and - for synthetic programs,
+# whose checksum can be compared between compiler versions instead. With
+# BASELINE set to an earlier results file, the two times are also given
+# as ratios to the baseline's. Results are saved in bench/out/results.tsv.
+
+LANGC=${LANGC:-./lang}
+REPEAT=${REPEAT:-3}
+SYNTH=${SYNTH:-"10x10x14 40x20x12 100x40x10"}
+OUT=bench/out
+
+case " $* " in
+    *" -m64 "*) LINK="gcc -O1" ;;
+    *)          LINK="gcc -O1 -m32" ;;
+esac
+
+now_ms() { date +%s%N | awk '{ printf "%.3f", $1 / 1000000 }'; }
+
+# best_ms command...  runs the command REPEAT times, prints the fastest
+best_ms() {
+    best=""
+    i=0
+    while [ $i -lt $REPEAT ]; do
+        t0=$(now_ms)
+        "$@" > $OUT/stdout || return 1
+        t1=$(now_ms)
+        best=$(echo "$t0 $t1 $best" | awk '{ t = $2 - $1; if($3 != "" && $3 < t) t = $3; printf "%.3f", t }')
+        i=$((i + 1))
+    done
+    echo $best
+}
+
+bench() {
+    name=$1; src=$2; shift 2
+    compile=$(best_ms $LANGC "$@" -o $OUT/$name.s $src) || { printf "%s\t-\t-\t-\t-\tCOMPILE_FAIL\n" $name; return; }
+    $LINK -o $OUT/$name runtime.c $OUT/$name.s || { printf "%s\t%s\t-\t-\t-\tLINK_FAIL\n" $name $compile; return; }
+    run=$(best_ms $OUT/$name) || { printf "%s\t%s\t-\t-\t-\tRUN_FAIL\n" $name $compile; return; }
+    lines=$(wc -l < $OUT/$name.s)
+    sum=$(cksum < $OUT/stdout | cut -d' ' -f1)
+    status=-
+    if [ -f bench/$name.expected ]; then
+        if cmp -s $OUT/stdout bench/$name.expected; then status=ok; else status=FAIL; fi
+    fi
+    printf "%s\t%s\t%s\t%s\t%s\t%s\n" $name $compile $run $lines $sum $status
+}
+
+mkdir -p $OUT
+# the baseline may be the results file this run is about to replace
+[ -n "$BASELINE" ] && cp "$BASELINE" $OUT/baseline.tsv
+{
+    printf "program\tcompile_ms\trun_ms\tasm_lines\toutput_cksum\tstatus\n"
+    for src in bench/*.lang; do
+        bench $(basename $src .lang) $src "$@"
+    done
+    for size in $SYNTH; do
+        set -- $(echo $size | tr x ' ') "$@"
+        awk -v classes=$1 -v methods=$2 -v depth=$3 -v seed=1 -f bench/gen.awk > $OUT/synth_$size.lang
+        shift 3
+        bench synth_$size $OUT/synth_$size.lang "$@"
+    done
+} > $OUT/results.tsv
+
+if [ -n "$BASELINE" ]; then
+    # join on program name and add compile and run time ratios
+    awk -F'\t' -v OFS='\t' 'NR == FNR { c[$1] = $2; r[$1] = $3; next }
+        FNR == 1 { print $0, "compile_x", "run_x"; next }
+        { cx = ($1 in c && c[$1] > 0) ? sprintf("%.2f", $2 / c[$1]) : "-"
+          rx = ($1 in r && r[$1] > 0) ? sprintf("%.2f", $3 / r[$1]) : "-"
+          print $0, cx, rx }' $OUT/baseline.tsv $OUT/results.tsv
+else
+    cat $OUT/results.tsv
+fi
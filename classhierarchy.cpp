@@ -1,27 +1,32 @@
 #include "classhierarchy.hpp"
+#include "stats.hpp"
+#include <assert.h>
 
 /****** ClassName Implemenation **************************************/
 
 ClassName::ClassName(char* const x)
 {
     m_spelling = x;
+    m_id = Interner::id(x);
+    assert( m_id >= 0 && m_id < identifiers.size() && identifiers.spelling(m_id) == x );
     m_parent_attribute = NULL;
 }
 ClassName::ClassName(const char* const x)
 {
-    m_spelling = strdup(x);
+    m_spelling = (char*)identifiers.intern(x);
+    m_id = Interner::id(m_spelling);
     m_parent_attribute = NULL;
 }
 
 ClassName::ClassName(const ClassName & other)
 {
-    m_spelling = strdup(other.m_spelling);
+    m_spelling = other.m_spelling;
+    m_id = other.m_id;
     m_parent_attribute = other.m_parent_attribute;
 }
 
 ClassName& ClassName::operator=(const ClassName & other)
 {
-    delete m_spelling;
     ClassName tmp(other);
     swap(tmp);
     return *this;
@@ -30,11 +35,12 @@ ClassName& ClassName::operator=(const ClassName & other)
 void ClassName::swap(ClassName & other)
 {
     std::swap(m_spelling, other.m_spelling);
+    std::swap(m_id, other.m_id);
 }
 
 ClassName::~ClassName()
 {
-    delete( m_spelling );
+    // the spelling belongs to identifiers
 }
 
 void ClassName::accept(Visitor *v)
@@ -56,7 +62,7 @@ const char* ClassName::spelling()
 
 ClassTable::ClassTable() {
     topClass = new ClassNode();
-    topClass->name = new ClassName((char * const) "TopClass");
+    topClass->name = new ClassName("TopClass");
     topClass->superClass = NULL;
     topClass->p = NULL;
     topClass->scope = NULL;
@@ -66,6 +72,20 @@ ClassTable::~ClassTable() {
     delete topClass;
 }
 
+ClassNode* ClassTable::lookup( int id ) {
+    stat_classtable_lookups++;
+    if(id >= 0 && id < (int)nameMap.size())
+        return nameMap[id];
+    return NULL;
+}
+
+ClassNode* ClassTable::insert( int id, ClassNode * node ) {
+    if(id >= (int)nameMap.size())
+        nameMap.resize(identifiers.size(), NULL);
+    nameMap[id] = node;
+    return node;
+}
+
 bool ClassTable::exist( ClassName* name ) {
     if(name)
         return (this->lookup(name) != NULL);
@@ -73,8 +93,7 @@ bool ClassTable::exist( ClassName* name ) {
 }
 
 ClassNode* ClassTable::insert( ClassName* name, ClassNode * node ) {
-    nameMap[std::string(name->spelling())] = node;
-    return node;
+    return insert(name->id(), node);
 }
 
 ClassNode* ClassTable::insert( ClassName * name, ClassName * superClass, ClassImpl * astNode, SymScope * classScope ) {
@@ -83,13 +102,12 @@ ClassNode* ClassTable::insert( ClassName * name, ClassName * superClass, ClassIm
     newNode->superClass = superClass;
     newNode->p = astNode;
     newNode->scope = classScope;
-    nameMap[std::string(name->spelling())] = newNode;
-    return newNode;
+    return insert(name->id(), newNode);
 }
 
 ClassNode* ClassTable::lookup( ClassName * name ) {
-    if(name && nameMap.find(std::string(name->spelling()))!=nameMap.end())
-        return nameMap[std::string(name->spelling())];
+    if(name)
+        return lookup(name->id());
     else
         return NULL;
 }
@@ -104,37 +122,55 @@ ClassNode* ClassTable::getParentOf( ClassName * name ) {
     else
         return NULL;
 }
-    bool  ClassTable::exist( const char * name ){
-	return this->exist(new ClassName(name));	
+
+// A name that was never interned cannot be a class, so the const char*
+// forms look names up without interning them
+bool ClassTable::exist( const char * name ) {
+    return this->lookup(name) != NULL;
 }
-    ClassNode*  ClassTable::insert( const char * name, ClassNode * node ){
-	return this->insert(new ClassName(name),node);
+
+ClassNode* ClassTable::insert( const char * name, ClassNode * node ) {
+    return insert(Interner::id(identifiers.intern(name)), node);
 }
 
-    ClassNode*  ClassTable::insert( const char  * name, const char * superClass, ClassImpl * astNode, SymScope * classScope ){
-	return this->insert(new ClassName(name),new ClassName(superClass),astNode,classScope);
+ClassNode* ClassTable::insert( const char  * name, const char * superClass, ClassImpl * astNode, SymScope * classScope ) {
+    return this->insert(new ClassName(name), superClass ? new ClassName(superClass) : NULL, astNode, classScope);
 }
-    ClassNode*  ClassTable::lookup( const char * name ){
-	return this->lookup(new ClassName(name));
+
+ClassNode* ClassTable::lookup( const char * name ) {
+    return lookup(identifiers.find(name));
 }
-   
-    ClassNode*  ClassTable::getParentOf( const char * name ){
-	return this->getParentOf(new ClassName(name));
+
+ClassNode* ClassTable::getParentOf( const char * name ) {
+    ClassNode *node = lookup(name);
+    if(node == NULL) return NULL;
+    return node->superClass ? lookup(node->superClass) : topClass;
 }
+
 /****** OffsetTable Implemenation **************************************/
-void OffsetTable::insert(const char * symname, int offset, int size, CompoundType type)
+OffsetTable::OffsetTable()
+{
+	totalSize=0;
+	paramSize=0;
+	m_base=NULL;
+	m_first=0;
+}
+void OffsetTable::extend(OffsetTable* base)
 {
-	m_offset[std::string(symname)]=offset;
-	m_size[std::string(symname)]=size;
-	m_type[std::string(symname)]=type;
+	assert(slots() == 0);
+	m_base=base;
+	m_first=base->slots();
+	totalSize=base->totalSize;
+	paramSize=base->paramSize;
 }
-int OffsetTable::get_offset(const char * symname)
+void OffsetTable::insert(int id, int offset, int size, CompoundType type)
 {
-	return m_offset[std::string(symname)];
+	Slot s = { id, offset, size, type };
+	m_slots.push_back(s);
 }
-int OffsetTable::get_size(const char * symname) 
+void OffsetTable::insert(const char * symname, int offset, int size, CompoundType type)
 {
-	return m_size[std::string(symname)];
+	insert(Interner::id(identifiers.intern(symname)), offset, size, type);
 }
 void OffsetTable::setTotalSize(int size)
 {
@@ -154,27 +190,14 @@ void OffsetTable::setParamSize(int size)
 }
 void OffsetTable::copyTo(OffsetTable*dest)
 {
+	// the copy owns every slot, so it does not depend on this table
 	if(dest)
 	{
-		dest->m_offset=m_offset;
-		dest->m_size=m_size;
-		dest->m_type=m_type;
+		dest->m_base=NULL;
+		dest->m_first=0;
+		dest->m_slots.clear();
+		for_each_slot([dest](const Slot& s) { dest->m_slots.push_back(s); });
 		dest->totalSize=totalSize;
 		dest->paramSize=paramSize;
 	}
 }
-
-CompoundType OffsetTable::get_type(const char * symname)
-{
-	return m_type[std::string(symname)];
-}
-OffsetTable::OffsetTable()
-{
-	totalSize=0;
-	paramSize=0;
-}
-bool OffsetTable::exist(const char * symname)
-{
-	return (m_offset.find(std::string(symname)))!=m_offset.end();
-}
-
@@ -4,31 +4,66 @@
 #include "ast.hpp"
 #include "attribute.hpp"
 #include "symtab.hpp"
+#include "intern.hpp"
 #include <unordered_map>
 #include <cstddef>
 #include <cstring>
-#include <string>
+#include <vector>
 
+// The layout of a class's fields or of a method's frame. Each insert takes
+// the next slot, so slot k describes the k-th name inserted; a name that is
+// inserted again (a field redeclared by a subclass) is found at its later
+// slot. A subclass's table starts out extending its superclass's: the
+// inherited slots are read from the superclass's table, not copied.
+//
+// There is no lookup by name: a pass that resolves variable references walks
+// the slots once and keeps its own index by identifier id, as IRGen does.
 class OffsetTable
 {
 
+public:
+
+    struct Slot
+    {
+        int id;         // identifier id of the name
+        int offset;
+        int size;
+        CompoundType type;
+    };
+
 private:
 
     int totalSize;
     int paramSize;
-    std::unordered_map<std::string,int > m_offset;
-    std::unordered_map<std::string,int > m_size;
-    std::unordered_map<std::string,CompoundType> m_type;
+    OffsetTable* m_base;        // the table whose slots come first, or NULL
+    int m_first;                // number of slots that belong to m_base
+    std::vector<Slot> m_slots;  // slots m_first onwards
 	
 public:
 
     OffsetTable();
+
+    // start this empty table off as a copy of base, sharing base's slots;
+    // base must not grow afterwards
+    void extend(OffsetTable* base);
 	
     void insert(const char * symname, int offset, int size,CompoundType type);
-    int get_offset(const char * symname);
-    int get_size(const char * symname);
-    CompoundType get_type(const char * symname);
-    bool exist(const char * symname);
+    // the same, by identifier id
+    void insert(int id, int offset, int size, CompoundType type);
+
+    // all slots, inherited ones first
+    int slots() const { return m_first + (int)m_slots.size(); }
+
+    // call f on every slot in order, inherited ones first; each table in
+    // the chain is read once, so this is linear in the number of slots
+    template<class F> void for_each_slot(F f) const
+    {
+        if(m_base != NULL) m_base->for_each_slot(f);
+        for(size_t k = 0; k < m_slots.size(); k++) f(m_slots[k]);
+    }
+
+    // the slot inserted last
+    const Slot& last_slot() const { return m_slots.back(); }
 	
     int getTotalSize();
     void setTotalSize(int);
@@ -39,20 +74,22 @@ public:
 
 
 class ClassName {
-    char* m_spelling; // "name" of the class
+    char* m_spelling; // "name" of the class, interned
+    int m_id;         // its id in identifiers
     
     public:
     
     ClassName(const ClassName &);
     ClassName &operator=(const ClassName &);
-    ClassName(char* const x);
-    ClassName(const char* const x);
+    ClassName(char* const x);       // x must come from identifiers.intern()
+    ClassName(const char* const x); // interns x
     ~ClassName();
     virtual void accept(Visitor *v);
     virtual ClassName *clone() const;
     void swap(ClassName &);
     
     const char* spelling();
+    int id() const { return m_id; }
     
     Attribute* m_parent_attribute;
 };
@@ -69,11 +106,15 @@ class ClassNode {
     ClassNode(){offset=new OffsetTable();}
 };
 
-typedef std::unordered_map<const std::string, ClassNode*, std::hash<std::string> > ClassMap;
+// indexed by identifier id, NULL where the identifier is not a class
+typedef std::vector<ClassNode*> ClassMap;
 
 class ClassTable {
     ClassMap nameMap;
     ClassNode * topClass;
+
+    ClassNode* lookup( int id );
+    ClassNode* insert( int id, ClassNode * node );
     
     public:
     ClassTable();
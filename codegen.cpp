@@ -1,59 +1,435 @@
-#include "ast.hpp"
-#include "symtab.hpp"
-#include "classhierarchy.hpp"
-#include "primitive.hpp"
+#include "ir.hpp"
+#include "asmbuffer.hpp"
+#include "compilecache.hpp"
+#include "parallel.hpp"
+#include "peephole.hpp"
 #include "assert.h"
-#include <typeinfo>
 #include <stdio.h>
-
-class Codegen : public Visitor
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Lowers the IR built by IRGen to 32-bit x86 assembly. Virtual registers are
+// mapped onto machine registers by a linear scan over each function; values
+// that do not fit, or that are live across a call, get a slot in the frame.
+// Each method is written to memory first and cleaned up by the peephole
+// optimizer on its way to an AsmBuffer, which writes the whole program out
+// at once.
+class Codegen
 {
   private:
   
   FILE * m_outputfile;
-  SymTab *m_symboltable;
-  ClassTable *m_classtable;
+  Peephole m_peephole;
+  bool m_usepeephole;
+  bool m_markers;       // #### comments naming the IR instruction behind each piece of assembly
+  CompileCache* m_cache;    // classes lowered by earlier compiles, or NULL
+  int m_jobs;           // threads to lower functions on
   
-  const char * heapStart="_heap_start";
-  const char * heapTop="_heap_top";
+  const char * allocFun="Alloc";
   const char * printFormat=".LC0";
   const char * printFun="Print";
-  const char * currClassName;
-  
-  OffsetTable*currClassOffset;
-  OffsetTable*currMethodOffset;
-
-  bool inMethod;
   
   // basic size of a word (integers and booleans) in bytes
   static const int wordsize = 4;
   
-  int label_count; //access with new_label
+  // Registers handed out to virtual registers. %ebx carries return values and
+  // is the scratch register for memory-to-memory moves, and %ebp/%esp hold
+  // the frame, so they are never allocated. Every allocated register is
+  // treated as trashed by a call.
+  static const int numregs = 5;
+  const char * regname[numregs] = {"%eax", "%ecx", "%edx", "%esi", "%edi"};
+  static const int eax = 0;
+  static const int edx = 2;
+
+  // Allocation for the function being lowered
+  IRFunction *currFunction;
+  std::vector<int> vreg_start;  // instruction position of the definition
+  std::vector<int> vreg_end;    // position of the last use
+  std::vector<int> vreg_reg;    // register index, or -1 if the value lives in the frame
+  std::vector<int> vreg_slot;   // %ebp offset of the value's frame slot
+  int frameSize;
   
   // ********** Helper functions ********************************
   
-  // this is used to get new unique labels (cleverly named label1, label2, ...)
-  int new_label() { return label_count++; }
-
-  // PART 1:
-  // 1) get arithmetic expressions on integers working:
-  //	  you wont really be able to run your code,
-  //	  but you can visually inspect it to see that the correct
-  //    chains of opcodes are being generated.
-  // 2) get function calls working:
-  //    if you want to see at least a very simple program compile
-  //    and link successfully against gcc-produced code, you
-  //    need to get at least this far
-  // 3) get boolean operation working
-  //    before we can implement any of the conditional control flow 
-  //    stuff, we need to have booleans worked out.  
-  // 4) control flow:
-  //    we need a way to have if-elses and for loops in our language. 
-  //
-  // Hint: Symbols have an associated member variable called m_offset
-  //    That offset can be used to figure out where in the activation 
-  //    record you should look for a particuar variable
-  
+  // Block labels are named after their function, so a function's assembly
+  // reads the same whatever else is in the program
+  std::string block(int b) { return currFunction->name + ".L" + std::to_string(b); }
+
+  // Give v its own slot below the locals
+  void spill(int v, int &nslots)
+  {
+    vreg_reg[v] = -1;
+    vreg_slot[v] = -wordsize*(currFunction->nlocals + ++nslots);
+  }
+
+  // Linear scan register allocation. There are no loops in the language and
+  // blocks are laid out in order, so the span from definition to last use in
+  // the instruction order is exactly where a value is live.
+  void linear_scan()
+  {
+    int n = currFunction->nvregs;
+    vreg_start.assign(n, -1);
+    vreg_end.assign(n, -1);
+    vreg_reg.assign(n, -1);
+    vreg_slot.assign(n, 0);
+    std::vector<int> hint(n, -1);
+    std::vector<int> callpos;
+
+    // Number the instructions and record the live intervals
+    int pos = 0;
+    std::vector<int> used;
+    for(size_t b = 0; b < currFunction->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = currFunction->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++, pos++) {
+        used.clear();
+        instrs[i].uses(used);
+        for(size_t u = 0; u < used.size(); u++) vreg_end[used[u]] = pos;
+        if(instrs[i].dst != no_vreg) {
+          vreg_start[instrs[i].dst] = vreg_end[instrs[i].dst] = pos;
+          hint[instrs[i].dst] = instrs[i].src1; // two-address form wants dst == src1
+        }
+        if(instrs[i].is_call() || instrs[i].op == ir_print || instrs[i].op == ir_new) callpos.push_back(pos);
+      }
+    }
+
+    std::vector<int> order;
+    for(int v = 0; v < n; v++) if(vreg_start[v] >= 0) order.push_back(v);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return vreg_start[a] < vreg_start[b]; });
+
+    int nslots = 0;
+    bool busy[numregs] = {false};
+    std::vector<int> active;
+    for(size_t k = 0; k < order.size(); k++) {
+      int v = order[k];
+
+      // Registers of values whose last use is this definition can be reused
+      for(size_t a = 0; a < active.size();) {
+        if(vreg_end[active[a]] <= vreg_start[v]) { busy[vreg_reg[active[a]]] = false; active.erase(active.begin()+a); }
+        else a++;
+      }
+
+      // Anything live across a call would be clobbered in a register
+      bool crosses = false;
+      for(size_t c = 0; c < callpos.size(); c++)
+        if(vreg_start[v] < callpos[c] && callpos[c] < vreg_end[v]) crosses = true;
+      if(crosses) { spill(v, nslots); continue; }
+
+      int r = -1;
+      if(hint[v] != no_vreg && vreg_reg[hint[v]] >= 0 && !busy[vreg_reg[hint[v]]]) r = vreg_reg[hint[v]];
+      for(int i = 0; i < numregs && r < 0; i++) if(!busy[i]) r = i;
+
+      // Out of registers: whichever value is live the longest goes to memory
+      if(r < 0) {
+        size_t far = 0;
+        for(size_t a = 1; a < active.size(); a++) if(vreg_end[active[a]] > vreg_end[active[far]]) far = a;
+        if(vreg_end[active[far]] <= vreg_end[v]) { spill(v, nslots); continue; }
+        r = vreg_reg[active[far]];
+        spill(active[far], nslots);
+        active.erase(active.begin()+far);
+      }
+
+      vreg_reg[v] = r;
+      busy[r] = true;
+      active.push_back(v);
+    }
+
+    frameSize = wordsize*(currFunction->nlocals + nslots);
+  }
+
+  // ********** Operand helpers ********************************
+
+  static bool is_reg(const std::string &l) { return l[0] == '%'; }
+
+  static std::string mem(int offset, const std::string &base)
+  {
+    char buf[32];
+    sprintf(buf, "%d(%s)", offset, base.c_str());
+    return buf;
+  }
+
+  // Where a virtual register lives
+  std::string loc(int v)
+  {
+    if(vreg_reg[v] >= 0) return regname[vreg_reg[v]];
+    return mem(vreg_slot[v], "%ebp");
+  }
+
+  // Arguments sit above the return address and the receiver, locals below %ebp
+  std::string frame_slot(int slot)
+  {
+    if(slot < currFunction->nparams) return mem(12 + wordsize*slot, "%ebp");
+    return mem(-wordsize*(slot - currFunction->nparams + 1), "%ebp");
+  }
+
+  void move(const std::string &src, const std::string &dst)
+  {
+    if(src == dst) return;
+    if(!is_reg(src) && !is_reg(dst) && src[0] != '$') {
+      fprintf( m_outputfile, "  movl %s, %%ebx\n", src.c_str());
+      fprintf( m_outputfile, "  movl %%ebx, %s\n", dst.c_str());
+    } else {
+      fprintf( m_outputfile, "  movl %s, %s\n", src.c_str(), dst.c_str());
+    }
+  }
+
+  // Object pointers have to be in a register to address their fields
+  std::string base_of(int v)
+  {
+    std::string o = loc(v);
+    if(is_reg(o)) return o;
+    move(o, "%ebx");
+    return "%ebx";
+  }
+
+  // ********** Instruction lowering ********************************
+
+  // dst = src1 op src2 for the two-address x86 arithmetic instructions
+  void lower_binary(IRInstr &in, const char* op, bool commutative)
+  {
+    std::string a = loc(in.src1), b = loc(in.src2), d = loc(in.dst);
+    if(!is_reg(d)) {
+      move(a, "%ebx");
+      fprintf( m_outputfile, "  %s %s, %%ebx\n", op, b.c_str());
+      move("%ebx", d);
+    } else if(d == b && in.src1 != in.src2) {
+      // the result register already holds the right operand
+      if(commutative) fprintf( m_outputfile, "  %s %s, %s\n", op, a.c_str(), d.c_str());
+      else {
+        fprintf( m_outputfile, "  negl %s\n", d.c_str());
+        fprintf( m_outputfile, "  addl %s, %s\n", a.c_str(), d.c_str());
+      }
+    } else {
+      move(a, d);
+      fprintf( m_outputfile, "  %s %s, %s\n", op, b.c_str(), d.c_str());
+    }
+  }
+
+  // Set the flags for src1 against src2
+  void lower_cmp(IRInstr &in)
+  {
+    std::string a = loc(in.src1), b = loc(in.src2);
+    if(!is_reg(a) && !is_reg(b)) { move(a, "%ebx"); a = "%ebx"; }
+    fprintf( m_outputfile, "  cmpl %s, %s\n", b.c_str(), a.c_str());
+  }
+
+  // Jump on the flags to target, else to target2, falling through where possible
+  void lower_jcc(IRInstr &in, const char* jcc, const char* jinverse, int next_block)
+  {
+    if(in.target == next_block) fprintf( m_outputfile, "  %s %s\n", jinverse, block(in.target2).c_str());
+    else {
+      fprintf( m_outputfile, "  %s %s\n", jcc, block(in.target).c_str());
+      if(in.target2 != next_block) fprintf( m_outputfile, "  jmp %s\n", block(in.target2).c_str());
+    }
+  }
+
+  void lower_compare(IRInstr &in, const char* setcc)
+  {
+    std::string d = loc(in.dst);
+    lower_cmp(in);
+    fprintf( m_outputfile, "  %s %%bl\n", setcc);
+    if(is_reg(d)) fprintf( m_outputfile, "  movzbl %%bl, %s\n", d.c_str());
+    else {
+      fprintf( m_outputfile, "  movzbl %%bl, %%ebx\n");
+      move("%ebx", d);
+    }
+  }
+
+  void lower_divide(IRInstr &in, int pos)
+  {
+    // idiv works on %edx:%eax, so save any other value live there
+    std::vector<int> saved;
+    for(int v = 0; v < currFunction->nvregs; v++)
+      if((vreg_reg[v] == eax || vreg_reg[v] == edx) && vreg_start[v] < pos && vreg_end[v] > pos)
+        saved.push_back(vreg_reg[v]);
+    for(size_t i = 0; i < saved.size(); i++) fprintf( m_outputfile, "  pushl %s\n", regname[saved[i]]);
+
+    // Divisor goes to memory if it sits in one of the registers idiv overwrites
+    std::string b = loc(in.src2);
+    bool divisor_on_stack = (b == regname[eax] || b == regname[edx]);
+    if(divisor_on_stack) {
+      fprintf( m_outputfile, "  pushl %s\n", b.c_str());
+      b = "(%esp)";
+    }
+    move(loc(in.src1), "%eax");
+    fprintf( m_outputfile, "  cdq\n"); // sign extend eax into edx
+    fprintf( m_outputfile, "  idivl %s\n", b.c_str());
+    if(divisor_on_stack) fprintf( m_outputfile, "  addl $4, %%esp\n");
+    move("%eax", loc(in.dst));
+
+    for(size_t i = saved.size(); i > 0; i--) fprintf( m_outputfile, "  popl %s\n", regname[saved[i-1]]);
+  }
+
+  void lower_unary(IRInstr &in, const char* op)
+  {
+    std::string d = loc(in.dst);
+    move(loc(in.src1), d);
+    fprintf( m_outputfile, "  %s %s\n", op, d.c_str());
+  }
+
+  // Arguments go on the stack last to first, the receiver is pushed last
+  void lower_call(IRInstr &in)
+  {
+    for(size_t i = in.args.size(); i > 0; i--)
+      fprintf( m_outputfile, "  pushl %s\n", loc(in.args[i-1]).c_str());
+    fprintf( m_outputfile, "  call %s\n", in.label.c_str());
+    fprintf( m_outputfile, "  addl $%i, %%esp\n", (int)in.args.size()*wordsize); // clean up parameters
+    move("%ebx", loc(in.dst));
+  }
+
+  // Same as a direct call, but the target comes from the receiver's vtable
+  void lower_vcall(IRInstr &in)
+  {
+    for(size_t i = in.args.size(); i > 0; i--)
+      fprintf( m_outputfile, "  pushl %s\n", loc(in.args[i-1]).c_str());
+    fprintf( m_outputfile, "  movl (%%esp), %%ebx\n");   // receiver
+    fprintf( m_outputfile, "  movl (%%ebx), %%ebx\n");   // its vtable
+    fprintf( m_outputfile, "  call *%s\n", mem(wordsize*in.imm, "%ebx").c_str());
+    fprintf( m_outputfile, "  addl $%i, %%esp\n", (int)in.args.size()*wordsize); // clean up parameters
+    move("%ebx", loc(in.dst));
+  }
+
+  void lower_storefield(IRInstr &in)
+  {
+    int offset = wordsize*in.imm;
+    std::string o = loc(in.src1), v = loc(in.src2);
+    if(is_reg(o)) move(v, mem(offset, o));
+    else if(is_reg(v)) move(v, mem(offset, base_of(in.src1)));
+    else {
+      // both in memory and %ebx is needed for the base
+      fprintf( m_outputfile, "  pushl %s\n", v.c_str());
+      base_of(in.src1);
+      fprintf( m_outputfile, "  popl %s\n", mem(offset, "%ebx").c_str());
+    }
+  }
+
+  void lower_instr(IRInstr &in, int pos, int next_block)
+  {
+    if(m_markers) fprintf( m_outputfile, "#### %s\n", ir_opname(in.op));
+    switch(in.op) {
+      case ir_const:
+        fprintf( m_outputfile, "  movl $%i, %s\n", in.imm, loc(in.dst).c_str());
+        break;
+      case ir_add: lower_binary(in, "addl", true); break;
+      case ir_sub: lower_binary(in, "subl", false); break;
+      case ir_mul: lower_binary(in, "imull", true); break;
+      case ir_div: lower_divide(in, pos); break;
+      case ir_lt: lower_compare(in, "setl"); break;
+      case ir_le: lower_compare(in, "setle"); break;
+      case ir_not: lower_unary(in, "xorl $1,"); break;
+      case ir_neg: lower_unary(in, "negl"); break;
+      case ir_shl: {
+        char op[16];
+        sprintf(op, "sall $%i,", in.imm);
+        lower_unary(in, op);
+        break;
+      }
+      case ir_self:
+        move("8(%ebp)", loc(in.dst));
+        break;
+      case ir_loadlocal:
+        move(frame_slot(in.imm), loc(in.dst));
+        break;
+      case ir_storelocal:
+        move(loc(in.src1), frame_slot(in.imm));
+        break;
+      case ir_loadfield:
+        move(mem(wordsize*in.imm, base_of(in.src1)), loc(in.dst));
+        break;
+      case ir_storefield:
+        lower_storefield(in);
+        break;
+      case ir_new: {
+        // the runtime hands back zeroed memory in %eax; fill in the vtable pointer
+        fprintf( m_outputfile, "  pushl $%i\n", wordsize*in.imm);
+        fprintf( m_outputfile, "  call %s\n", allocFun);
+        fprintf( m_outputfile, "  addl $%i, %%esp\n", wordsize);
+        fprintf( m_outputfile, "  movl $%s, (%%eax)\n", in.label.c_str());
+        move("%eax", loc(in.dst));
+        break;
+      }
+      case ir_framenew: {
+        // field 0 sits in the highest-numbered slot, which is the lowest address
+        std::string d = loc(in.dst);
+        std::string r = is_reg(d) ? d : "%ebx";
+        fprintf( m_outputfile, "  leal %s, %s\n", frame_slot(in.imm).c_str(), r.c_str());
+        fprintf( m_outputfile, "  movl $%s, (%s)\n", in.label.c_str(), r.c_str());
+        move(r, d);
+        break;
+      }
+      case ir_call:
+        lower_call(in);
+        break;
+      case ir_vcall:
+        lower_vcall(in);
+        break;
+      case ir_print:
+        fprintf( m_outputfile, "  pushl %s\n", loc(in.src1).c_str());
+        fprintf( m_outputfile, "  call %s\n", printFun);
+        fprintf( m_outputfile, "  addl $4, %%esp\n"); // clean up parameter
+        break;
+      case ir_jump:
+        if(in.target != next_block) fprintf( m_outputfile, "  jmp %s\n", block(in.target).c_str());
+        break;
+      case ir_branch:
+        fprintf( m_outputfile, "  cmpl $0, %s\n", loc(in.src1).c_str());
+        lower_jcc(in, "jne", "je", next_block);
+        break;
+      case ir_blt:
+        lower_cmp(in);
+        lower_jcc(in, "jl", "jge", next_block);
+        break;
+      case ir_ble:
+        lower_cmp(in);
+        lower_jcc(in, "jle", "jg", next_block);
+        break;
+      case ir_ret:
+        // Return value goes in %ebx, 0 if the method returns Nothing
+        if(in.src1 != no_vreg) move(loc(in.src1), "%ebx");
+        else fprintf( m_outputfile, "  movl $0, %%ebx\n");
+        fprintf( m_outputfile, "  leave\n");
+        fprintf( m_outputfile, "  ret\n");
+        break;
+    }
+  }
+
+  void lower(IRFunction *f)
+  {
+    FILE* out = m_outputfile;
+    char* buf = NULL;
+    size_t len = 0;
+    if(m_usepeephole) m_outputfile = open_memstream(&buf, &len);
+
+    currFunction = f;
+    linear_scan();
+
+    if(m_markers) fprintf(m_outputfile, "######## METHOD\n");
+    fprintf(m_outputfile, "%s:\n", f->name.c_str());
+
+    // Prologue - Push old ebp to stack, update ebp to current stack pointer, make room for locals and spills
+    fprintf(m_outputfile, "  pushl %%ebp\n");
+    fprintf(m_outputfile, "  movl %%esp, %%ebp\n");
+    if(frameSize > 0) fprintf(m_outputfile, "  subl $%i, %%esp\n", frameSize);
+
+    int pos = 0;
+    for(size_t b = 0; b < f->blocks.size(); b++) {
+      if(b > 0) fprintf(m_outputfile, "%s:\n", block(b).c_str());
+      std::vector<IRInstr> &instrs = f->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++, pos++)
+        lower_instr(instrs[i], pos, b+1);
+    }
+    if(m_markers) fprintf(m_outputfile, "########\n");
+    fprintf(m_outputfile, "\n");
+
+    if(m_usepeephole) {
+      fclose(m_outputfile);
+      m_outputfile = out;
+      m_peephole.run(std::string(buf, len), m_outputfile);
+      free(buf);
+    }
+  }
+
   ///////////////////////////////////////////////////////////////////////////////
   //
   //  function_prologue
@@ -127,11 +503,65 @@ class Codegen : public Visitor
   //		   o %ebp, %ebx, %esi, %edi are "callee save" registers 
   ////////////////////////////////////////////////////////////////////////////////
   
+  // functions[first..last) as assembly text; taken from the cache if they
+  // are a whole class that was lowered the same way before
+  void lower_range(IRProgram *program, size_t first, size_t last, std::string &text)
+  {
+    std::string key;
+    if(m_cache != NULL) {
+      key = m_cache->asm_key(std::string("x86") + (m_usepeephole ? " peephole" : "") + (m_markers ? " markers" : ""), program, first, last);
+      if(m_cache->find(key, text)) {
+        m_cache->hits++;
+        return;
+      }
+      m_cache->misses++;
+    }
+    FILE* out = m_outputfile;
+    char* buf = NULL;
+    size_t len = 0;
+    m_outputfile = open_memstream(&buf, &len);
+    for(size_t i = first; i < last; i++) lower(program->functions[i]);
+    fclose(m_outputfile);
+    m_outputfile = out;
+    text.assign(buf, len);
+    free(buf);
+    if(m_cache != NULL) m_cache->store(key, text);
+  }
+
+  // Every function, on m_jobs threads. Each thread lowers with a Codegen of
+  // its own, since lowering keeps per-function state in the object, and
+  // block labels are named after their function, so no two pieces of work
+  // share anything. The pieces are written out in program order whichever
+  // finished first, so the output is the same for any number of jobs.
+  void lower_all(IRProgram *program)
+  {
+    // a class's methods are next to each other, and the cache keeps whole
+    // classes; without one, each method is a piece of work on its own
+    std::vector<IRFunction*> &fns = program->functions;
+    std::vector<std::pair<size_t, size_t> > units;
+    for(size_t i = 0, j; i < fns.size(); i = j) {
+      for(j = i + 1; j < fns.size() && fns[j]->cls == fns[i]->cls; j++) ;
+      if(m_cache != NULL) units.push_back(std::make_pair(i, j));
+      else for(size_t k = i; k < j; k++) units.push_back(std::make_pair(k, k + 1));
+    }
+
+    std::vector<Codegen*> workers(1, this);
+    for(int t = 1; t < m_jobs && t < (int)units.size(); t++) workers.push_back(new Codegen(NULL, m_usepeephole, m_markers, m_cache));
+    std::vector<std::string> texts(units.size());
+    parallel_for(units.size(), workers.size(), [&](int t, size_t u) {
+      workers[t]->lower_range(program, units[u].first, units[u].second, texts[u]);
+    });
+    for(size_t t = 1; t < workers.size(); t++) {
+      m_peephole.merge(workers[t]->m_peephole);
+      delete workers[t];
+    }
+
+    for(size_t u = 0; u < texts.size(); u++) fwrite(texts[u].data(), 1, texts[u].size(), m_outputfile);
+  }
+
   void init()
   {
     fprintf( m_outputfile, ".text\n\n");
-    fprintf( m_outputfile, ".comm %s,4,4\n", heapStart);
-    fprintf( m_outputfile, ".comm %s,4,4\n\n", heapTop);
     
     fprintf( m_outputfile, "%s:\n", printFormat);
     fprintf( m_outputfile, "       .string \"%%d\\n\"\n");
@@ -158,637 +588,79 @@ class Codegen : public Visitor
     fprintf( m_outputfile, "Start:\n");
     fprintf( m_outputfile, "        pushl   %%ebp\n");
     fprintf( m_outputfile, "        movl    %%esp, %%ebp\n");
-    fprintf( m_outputfile, "        movl    8(%%ebp), %%ecx\n");
-    fprintf( m_outputfile, "        movl    %%ecx, %s\n",heapStart);
-    fprintf( m_outputfile, "        movl    %%ecx, %s\n",heapTop);
-    fprintf( m_outputfile, "        addl    $%d, %s\n",programSize,heapTop);
-    fprintf( m_outputfile, "        pushl   %s \n",heapStart);
+    // generated methods treat every register as scratch, so save the ones
+    // our C caller expects to survive
+    fprintf( m_outputfile, "        pushl   %%ebx\n");
+    fprintf( m_outputfile, "        pushl   %%esi\n");
+    fprintf( m_outputfile, "        pushl   %%edi\n");
+    fprintf( m_outputfile, "        pushl   $%d\n",programSize);
+    fprintf( m_outputfile, "        call    %s\n",allocFun);
+    fprintf( m_outputfile, "        movl    $Program_vtable, (%%eax)\n");
+    fprintf( m_outputfile, "        movl    %%eax, (%%esp)\n");
     fprintf( m_outputfile, "        call    Program_start \n");
+    fprintf( m_outputfile, "        leal    -12(%%ebp), %%esp\n");
+    fprintf( m_outputfile, "        popl    %%edi\n");
+    fprintf( m_outputfile, "        popl    %%esi\n");
+    fprintf( m_outputfile, "        popl    %%ebx\n");
     fprintf( m_outputfile, "        leave\n");
     fprintf( m_outputfile, "        ret\n");
   }
 
-  void allocSpace(int size)
-  {
-	// Optional WRITE ME
-  }
-
 ////////////////////////////////////////////////////////////////////////////////
 public:
+
+  long emitted;   // assembly instructions written, after the peephole pass
   
-  Codegen(FILE * outputfile, SymTab * st, ClassTable* ct)
+  Codegen(FILE * outputfile, bool usepeephole = true, bool markers = true, CompileCache* cache = NULL, int jobs = 1)
   {
     m_outputfile = outputfile;
-    m_symboltable = st;
-    m_classtable = ct;
-    label_count = 0;
-    currMethodOffset=currClassOffset=NULL;
-  }
-  //=====================================================================================================================
-  void visitProgramImpl(ProgramImpl *p) {
-
-	init();
-    // Visit the children
-    p->visit_children(this);
-
-    start(m_classtable->lookup("Program")->offset->getTotalSize());
-
-  }
-  //=====================================================================================================================
-  void visitClassImpl(ClassImpl *p) {
-
-      fprintf(m_outputfile, "############ CLASS\n");
-
-      // Set current class name for function labels
-      currClassName = dynamic_cast<ClassIDImpl*>(p->m_classid_1)->m_classname->spelling();
-
-      // Create this class's classnode and insert into class table
-      ClassNode* node = new ClassNode();
-      node->name = new ClassName(currClassName);
-      node->superClass = NULL;
-      node->scope = new SymScope(); // only used for holding methods
-      node->p = p;
-      if(p->m_classid_2!=NULL) {
-          const char* superclass = dynamic_cast<ClassIDImpl*>(p->m_classid_2)->m_classname->spelling();
-          assert(m_classtable->exist(superclass));
-          node->superClass = new ClassName(superclass);
-          m_classtable->lookup(superclass)->offset->copyTo(node->offset);
-      }
-      currClassOffset = node->offset;
-      m_classtable->insert(node->name->spelling(), node);
-
-      inMethod = false;
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf(m_outputfile, "############\n\n");
-  }
-  //=====================================================================================================================
-  void visitDeclarationImpl(DeclarationImpl *p) {
-
-      fprintf(m_outputfile, "#### DECLARATION\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      // Get type and decide on allocated size
-      Basetype type = p->m_type->m_attribute.m_type.baseType;
-      assert(type == bt_boolean || type == bt_integer || type == bt_object);
-      int varSize = 4;
-
-      // Iterate through list of variables, allocating and inserting into offset table
-      list<VariableID_ptr> *l = p->m_variableid_list;
-      list<VariableID_ptr>::iterator it;
-      OffsetTable* table; bool isClassDec; int offsetDir;
-      if(inMethod) { table = currMethodOffset; isClassDec = false; offsetDir = -1; }
-      else{ table = currClassOffset; isClassDec = true; offsetDir = 1; }
-      VariableIDImpl* var; VariableID_ptr ptr;
-      int curroffset;
-      for(it=l->begin(); it!=l->end(); ++it) {
-            ptr = (VariableID_ptr)*it;
-            var = dynamic_cast<VariableIDImpl*> (ptr);
-            // Allocate space in stack/heap if not a class declaration
-            if(type == bt_object && !isClassDec) {
-                const char* c = p->m_type->m_attribute.m_type.classType.classID;
-                assert(c != "");
-                assert(m_classtable->exist(c));
-                ClassNode* node = m_classtable->lookup(c);
-                fprintf( m_outputfile, "  pushl   %s\n",heapTop); // push current heap top to stack as pointer to obj
-                fprintf( m_outputfile, "  addl    $%d, %s\n",node->offset->getTotalSize(),heapTop); // allocate in heap
-            } else if(!isClassDec) {
-                fprintf(m_outputfile, "  subl $%i, %%esp\n", varSize);
-            }
-            // Insert into and update offset table
-            curroffset = table->getTotalSize();
-            table->insert(var->m_symname->spelling(), offsetDir*curroffset, varSize, p->m_type->m_attribute.m_type.classType);
-            //fprintf( m_outputfile, "%i, %i, %i, %i\n", inMethod, offsetDir, curroffset, varSize);
-            table->setTotalSize(offsetDir*(offsetDir*curroffset+offsetDir*varSize));
-      }
-
-      fprintf(m_outputfile, "####\n");
+    m_cache = cache;
+    m_jobs = jobs;
+    emitted = 0;
+    m_usepeephole = usepeephole;
+    m_markers = markers;
+    currFunction = NULL;
+    frameSize = 0;
   }
   //=====================================================================================================================
-  void visitMethodImpl(MethodImpl *p) {
-
-      inMethod = true;
-
-      fprintf(m_outputfile, "######## METHOD\n");
-
-      // Create function label from class name and method name
-      const char* funcname = dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname->spelling();
-      fprintf(m_outputfile, "%s_%s:\n", currClassName, funcname);
-
-
-      // Prologue - Push old ebp to stack, update ebp to current stack pointer
-      fprintf(m_outputfile, "  pushl %%ebp\n");
-      fprintf(m_outputfile, "  movl %%esp, %%ebp\n");
-
-      // Set offset tables
-      assert(m_classtable->exist(currClassName));
-      ClassNode* node = m_classtable->lookup(currClassName);
-      currClassOffset = node->offset;
-      currMethodOffset = new OffsetTable();
-      currMethodOffset->setTotalSize(4); // make space in table for %ebp
-
-      // Add function to classnode's scope
-      node->scope->insert(funcname, new Symbol());
-      assert(node->scope->exist(funcname));
-
-      // Iterate through parameters, saving to offset table
-      list<Parameter_ptr> *l = p->m_parameter_list;
-      list<Parameter_ptr>::iterator it;
-      OffsetTable* table = currMethodOffset;
-      ParameterImpl* param; Parameter_ptr ptr;
-      int varSize = 4;
-      int curroffset = 12; // leave space for return address and the 'this object' pointer
-      for(it=l->begin(); it!=l->end(); ++it) {
-            ptr = (Parameter_ptr)*it;
-            param = dynamic_cast<ParameterImpl*> (ptr);
-            table->insert(dynamic_cast<VariableIDImpl*>(param->m_variableid)->m_symname->spelling(), curroffset, varSize, param->m_type->m_attribute.m_type.classType);
-            curroffset += varSize;
-      }
-
-      // Visit the children
-      p->visit_children(this);
-
-      // Epilogue - deallocate locals, set ebp to old ebp, return
-      curroffset = currMethodOffset->getTotalSize();
-      fprintf(m_outputfile, "  addl $%i, %%esp\n", curroffset-4); // everything but old ebp
-      fprintf( m_outputfile,"  leave\n");
-      fprintf( m_outputfile,"  ret\n");
-      fprintf(m_outputfile, "########\n");
-
-      // Dereference the local offset table
-      currMethodOffset == NULL;
-
-      inMethod = false;
-  }
-  //=====================================================================================================================
-  void visitMethodBodyImpl(MethodBodyImpl *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitParameterImpl(ParameterImpl *p) {
-		
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitAssignment(Assignment *p) {
-
-      fprintf(m_outputfile, "#### ASSIGN\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      // Look up variable offset in offset table
-      OffsetTable* table = currMethodOffset; bool inClass = false;
-      const char* name = dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling();
-      if(!table->exist(name)) {table = currClassOffset; inClass = true;}
-      assert(table->exist(name));
-      int offset = table->get_offset(name);
-
-      // Pop from stack and save to either stack or heap
-      if(!inClass) {
-          fprintf(m_outputfile, "  popl %%eax\n");
-          fprintf(m_outputfile, "  movl %%eax, %i(%%ebp)\n", offset);
-      } else {
-          fprintf(m_outputfile, "  popl %%eax\n");
-          fprintf(m_outputfile, "  movl 8(%%ebp), %%ebx\n");
-          fprintf(m_outputfile, "  movl %%eax, %i(%%ebx)\n", offset);
-      }
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitIf(If *p) {
-
-      fprintf(m_outputfile, "#### CNDTL\n");
-
-      // Get int for next branch flag
-      int loc = new_label();
-
-      // Visit expression child to push value, create conditional command
-      p->m_expression->accept(this);
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cmp  $1, %%eax\n");
-      fprintf( m_outputfile, "  jne L%i\n", loc);
-
-      // Visit statement child to produce branched statement
-      p->m_statement->accept(this);
-
-      // Create label
-      fprintf( m_outputfile, "L%i:\n", loc);
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitPrint(Print *p) {
-
-      fprintf(m_outputfile, "#### PRINT\n");
-	
-      // Visit the children
-      p->visit_children(this);
-
-      // Call print on pushed result of child expression
-      fprintf(m_outputfile, "  call Print\n");
-      fprintf(m_outputfile, "  addl $4, %%esp\n"); // clean up parameter
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitReturnImpl(ReturnImpl *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf(m_outputfile, "#### RETRN\n");
-
-      // Pop result of child expression to %ebx, which won't be used before the end of the function
-      if(p->m_attribute.m_type.baseType != bt_nothing) fprintf(m_outputfile, "  popl %%ebx\n");
-      else fprintf(m_outputfile, "  movl $0, %%ebx\n"); // Return 0 if value is a Nothing
-
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitTInteger(TInteger *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitTBoolean(TBoolean *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitTNothing(TNothing *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitTObject(TObject *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitClassIDImpl(ClassIDImpl *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitVariableIDImpl(VariableIDImpl *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitMethodIDImpl(MethodIDImpl *p) {
-
-      // Visit the children
-      p->visit_children(this);
-
-  }
-  //=====================================================================================================================
-  void visitPlus(Plus *p) {
-
-     fprintf(m_outputfile, "#### ADD\n");
-
-     // Visit the children
-     p->visit_children(this);
-
-     fprintf( m_outputfile, "  popl %%ebx\n");
-     fprintf( m_outputfile, "  popl %%eax\n");
-     fprintf( m_outputfile, "  addl %%ebx, %%eax\n");
-     fprintf( m_outputfile, "  pushl %%eax\n");
-     fprintf(m_outputfile, "####\n");
-  }
-  //=====================================================================================================================
-  void visitMinus(Minus *p) {
-
-      fprintf(m_outputfile, "#### SUB\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  subl %%ebx, %%eax\n");
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitTimes(Times *p) {
-
-      fprintf(m_outputfile, "#### MLT\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  imul %%ebx, %%eax\n");
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitDivide(Divide *p) {
-
-      fprintf(m_outputfile, "#### DIV\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  movl $0, %%edx\n"); // clear dividend
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cdq\n"); // sign extend eax into edx
-      fprintf( m_outputfile, "  idiv %%ebx\n");
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitAnd(And *p) {
-
-      fprintf(m_outputfile, "#### AND\n");
-
-      // Get two label locations
-      int loc1 = new_label(); int loc2 = new_label();
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cmp $0, %%eax\n");
-      fprintf( m_outputfile, "  je L%i\n", loc1);
-      fprintf( m_outputfile, "  cmp $0, %%ebx\n");
-      fprintf( m_outputfile, "  je L%i\n", loc1);
-      fprintf( m_outputfile, "  mov $1, %%eax\n");
-      fprintf( m_outputfile, "  jmp L%i\n", loc2);
-      fprintf( m_outputfile, "L%i:\n", loc1);
-      fprintf( m_outputfile, "  mov $0, %%eax\n");
-      fprintf( m_outputfile, "L%i:\n", loc2);
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitLessThan(LessThan *p) {
-
-      fprintf(m_outputfile, "#### LT\n");
-
-      // Get two label locations
-      int loc1 = new_label(); int loc2 = new_label();
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cmp %%ebx, %%eax\n");
-      fprintf( m_outputfile, "  jl L%i\n", loc1);
-      fprintf( m_outputfile, "  pushl $0\n");
-      fprintf( m_outputfile, "  jmp L%i\n", loc2);
-      fprintf( m_outputfile, "L%i:\n", loc1);
-      fprintf( m_outputfile, "  pushl $1\n");
-      fprintf( m_outputfile, "L%i:\n", loc2);
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitLessThanEqualTo(LessThanEqualTo *p) {
-
-      fprintf(m_outputfile, "#### LT\n");
-
-      // Get two label locations
-      int loc1 = new_label(); int loc2 = new_label();
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%ebx\n");
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cmp %%ebx, %%eax\n");
-      fprintf( m_outputfile, "  jle L%i\n", loc1);
-      fprintf( m_outputfile, "  pushl $0\n");
-      fprintf( m_outputfile, "  jmp L%i\n", loc2);
-      fprintf( m_outputfile, "L%i:\n", loc1);
-      fprintf( m_outputfile, "  pushl $1\n");
-      fprintf( m_outputfile, "L%i:\n", loc2);
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitNot(Not *p) {
-
-      fprintf(m_outputfile, "#### NOT\n");
-
-      // Get two label locations
-      int loc1 = new_label(); int loc2 = new_label();
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  cmp $0, %%eax\n");
-      fprintf( m_outputfile, "  jne L%i\n", loc1);
-      fprintf( m_outputfile, "  mov $1, %%eax\n");
-      fprintf( m_outputfile, "  jmp L%i\n", loc2);
-      fprintf( m_outputfile, "L%i:\n", loc1);
-      fprintf( m_outputfile, "  mov $0, %%eax\n");
-      fprintf( m_outputfile, "L%i:\n", loc2);
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitUnaryMinus(UnaryMinus *p) {
-
-      fprintf(m_outputfile, "#### NEG\n");
-
-      // Visit the children
-      p->visit_children(this);
-
-      fprintf( m_outputfile, "  popl %%eax\n");
-      fprintf( m_outputfile, "  negl %%eax\n");
-      fprintf( m_outputfile, "  pushl %%eax\n");
-      fprintf(m_outputfile, "####\n");
-
-  }
-  //=====================================================================================================================
-  void visitMethodCall(MethodCall *p) {
-
-      fprintf(m_outputfile, "#### METHC\n");
-
-      // Visit variable and method name
-      p->m_methodid->accept(this);
-      p->m_variableid->accept(this);
-
-      // Grab variable's classname (for jump label) from offset table
-      OffsetTable* table = currMethodOffset; bool inClass=false;
-      const char* varname = dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling();
-      if(!table->exist(varname)) {table = currClassOffset; inClass=true;}
-      assert(table->exist(varname));
-      CompoundType type = table->get_type(varname);
-      const char* name;
-      name = type.classID;
-
-      // Visit parameters in reverse order, so their results will end up on the stack in x86 convention order
-      int numparams = 0;
-      list<Expression_ptr> *l = p->m_expression_list;
-      list<Expression_ptr>::iterator it;
-      Expression* exp; Expression_ptr ptr;
-      for(it=l->end(); it!=l->begin();) {
-            --it;
-            ptr = (Expression_ptr)*it;
-            exp = dynamic_cast<Expression*> (ptr);
-            exp->accept(this);
-            numparams++;
-      }
-
-      // Push referenced object's pointer to stack as final parameter
-      if(!inClass) {
-        fprintf( m_outputfile, "  pushl %i(%%ebp)\n", table->get_offset(varname));
-      } else {
-        fprintf( m_outputfile, "  movl 8(%%ebp), %%ebx\n");
-        fprintf( m_outputfile, "  pushl %i(%%ebx)\n", table->get_offset(varname));
-      }
-      numparams++;
-
-      // Find class/superclass that contains the function
-      const char* funcname = dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname->spelling();
-      ClassNode* node = m_classtable->lookup(name);
-      assert(node!=NULL);
-      while(!(node->scope->exist(funcname))) {
-          assert(node->superClass != NULL);
-          node = m_classtable->lookup(node->superClass);
-      }
-
-      // Call the function
-      fprintf(m_outputfile, "  call %s_%s\n", node->name->spelling(), funcname);
-
-      // Clean up parameters
-      fprintf(m_outputfile, "  addl $%i, %%esp\n", numparams*4);
-
-      // Push return value
-      fprintf(m_outputfile, "  pushl %%ebx\n");
-      fprintf(m_outputfile, "####\n");
-
+  // One table of method addresses per class, indexed by vtable slot
+  void vtables(IRProgram *program)
+  {
+    fprintf( m_outputfile, "\n# Virtual Method Tables\n");
+    fprintf( m_outputfile, ".section .rodata\n");
+    fprintf( m_outputfile, ".align 4\n");
+    for(size_t i = 0; i < program->classes.size(); i++) {
+      IRClass* c = program->classes[i];
+      fprintf( m_outputfile, "%s:\n", c->vtable_label().c_str());
+      for(size_t s = 0; s < c->vtable.size(); s++)
+        fprintf( m_outputfile, "        .long   %s\n", c->vtable[s].c_str());
+    }
   }
+  // How much each peephole rule removed, as assembly comments
+  void peephole_report() { m_peephole.report(m_outputfile); }
   //=====================================================================================================================
-  void visitSelfCall(SelfCall *p) {
-
-      fprintf(m_outputfile, "#### SELFC\n");
-
-      // Visit method name
-      p->m_methodid->accept(this);
-
-      // Visit parameters in reverse order, so their results will end up on the stack in x86 convention order
-      int numparams = 0;
-      list<Expression_ptr> *l = p->m_expression_list;
-      list<Expression_ptr>::iterator it;
-      Expression* exp; Expression_ptr ptr;
-      for(it=l->end(); it!=l->begin();) {
-            --it;
-            ptr = (Expression_ptr)*it;
-            exp = dynamic_cast<Expression*> (ptr);
-            exp->accept(this);
-            numparams++;
-      }
+  void generate(IRProgram *program) {
 
-      // Push current object's pointer to stack as final parameter
-      fprintf( m_outputfile, "  pushl 8(%%ebp)\n");
-      numparams++;
-
-      // Find class/superclass that contains the function
-      const char* funcname = dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname->spelling();
-      ClassNode* node = m_classtable->lookup(currClassName);
-      assert(node!=NULL);
-      while(!(node->scope->exist(funcname))) {
-          assert(node->superClass != NULL);
-          node = m_classtable->lookup(node->superClass);
-      }
-
-      // Call the function
-      fprintf(m_outputfile, "  call %s_%s\n", node->name->spelling(), funcname);
+    // everything goes out in one write at the end
+    FILE* out = m_outputfile;
+    AsmBuffer buffer(out);
+    m_outputfile = buffer.stream();
 
-      // Clean up parameters
-      fprintf(m_outputfile, "  addl $%i, %%esp\n", numparams*4);
+    init();
 
-      // Push return value
-      fprintf(m_outputfile, "  pushl %%ebx\n");
-      fprintf(m_outputfile, "####\n");
+    if(m_jobs > 1 || m_cache != NULL) lower_all(program);
+    else {
+      for(size_t i = 0; i < program->functions.size(); i++)
+        lower(program->functions[i]);
+    }
 
-  }
-  //=====================================================================================================================
-  void visitVariable(Variable *p) {
+    start(program->programSize*wordsize);
 
-      fprintf(m_outputfile, "## VAR\n");
+    vtables(program);
 
-      // Visit the children
-      p->visit_children(this);
-
-      // Look up variable offset and type in offset table
-      OffsetTable* table = currMethodOffset;
-      bool inClass=false;
-      const char* name = dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling();
-      if(!table->exist(name)) {table = currClassOffset; inClass=true;}
-      assert(table->exist(name));
-      int offset = table->get_offset(name);
-
-      // Push from either stack or heap, depending on where variable is located
-      if(!inClass) fprintf(m_outputfile, "  pushl %i(%%ebp)\n", offset);
-      else {
-          fprintf(m_outputfile, "  mov 8(%%ebp), %%eax\n", offset);
-          fprintf(m_outputfile, "  pushl %i(%%eax)\n", offset);
-      }
-      fprintf(m_outputfile, "##\n");
-  }
-  //=====================================================================================================================
-  void visitIntegerLiteral(IntegerLiteral *p) {
-      // Visit the children
-      p->visit_children(this);
-  }
-  //=====================================================================================================================
-  void visitBooleanLiteral(BooleanLiteral *p) {
-      // Visit the children
-      p->visit_children(this);
+    buffer.flush();
+    emitted = buffer.instructions();
+    m_outputfile = out;
   }
   //=====================================================================================================================
-  void visitNothing(Nothing *p) {}
-  //=====================================================================================================================
-  void visitSymName(SymName *p) {}
-  //=====================================================================================================================
-  void visitPrimitive(Primitive *p) {
-      fprintf(m_outputfile, "  pushl $%i\n", p->m_data);
-  }
-  //=====================================================================================================================
-  void visitClassName(ClassName *p) {}
-  //=====================================================================================================================
-  void visitNullPointer() {}
-  //=====================================================================================================================
 };
-
-
-
-
@@ -0,0 +1,620 @@
+#include "ir.hpp"
+#include "asmbuffer.hpp"
+#include "compilecache.hpp"
+#include "parallel.hpp"
+#include "assert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Lowers the IR built by IRGen to x86-64 assembly for the System V ABI.
+//
+// Every frame slot, field and virtual register is 8 bytes so it can hold an
+// object pointer. Ints keep their 32-bit semantics: arithmetic, compares and
+// printing use the 32-bit forms of the registers, and values are always
+// moved as whole quadwords.
+//
+// Methods take the receiver in %rdi and the first five parameters in %rsi,
+// %rdx, %rcx, %r8 and %r9; the rest are pushed last to first as before.
+// Results come back in %rax. The prologue copies the register arguments to
+// home slots in the frame, so the IR's parameter slots stay memory.
+//
+// Values that are live across a call get callee-saved registers, which the
+// method saves in its frame. %rax and %rdx are left free for idiv and
+// results, and %r11 is the scratch register.
+class Codegen64
+{
+  private:
+
+  FILE * m_outputfile;
+  bool m_markers;       // #### comments naming the IR instruction behind each piece of assembly
+  CompileCache* m_cache;    // classes lowered by earlier compiles, or NULL
+  int m_jobs;           // threads to lower functions on
+
+  const char * allocFun="Alloc";
+  const char * printFormat=".LC0";
+  const char * printFun="Print";
+
+  static const int wordsize = 8;
+
+  // Caller-saved registers first, then callee-saved ones
+  static const int numregs = 11;
+  static const int first_callee_saved = 6;
+  const char * regname[numregs] = {"%rcx", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%rbx", "%r12", "%r13", "%r14", "%r15"};
+  const char * regname32[numregs] = {"%ecx", "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+  // Registers arguments are passed in, receiver first
+  static const int numargregs = 6;
+  const char * argreg[numargregs] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+  // Allocation for the function being lowered
+  IRFunction *currFunction;
+  std::vector<int> vreg_start;  // instruction position of the definition
+  std::vector<int> vreg_end;    // position of the last use
+  std::vector<int> vreg_reg;    // register index, or -1 if the value lives in the frame
+  std::vector<int> vreg_spill;  // spill slot number for values in the frame
+  std::vector<int> saved;       // callee-saved registers this function uses
+  int homes;                    // words of register arguments copied into the frame
+  int frameSize;
+
+  // ********** Helper functions ********************************
+
+  // Block labels are named after their function, so a function's assembly
+  // reads the same whatever else is in the program
+  std::string block(int b) { return currFunction->name + ".L" + std::to_string(b); }
+
+  // Linear scan register allocation, as in the 32-bit backend. A value that
+  // is live across a call can only have a callee-saved register.
+  void linear_scan()
+  {
+    int n = currFunction->nvregs;
+    vreg_start.assign(n, -1);
+    vreg_end.assign(n, -1);
+    vreg_reg.assign(n, -1);
+    vreg_spill.assign(n, -1);
+    std::vector<int> hint(n, -1);
+    std::vector<int> callpos;
+
+    int pos = 0;
+    std::vector<int> used;
+    for(size_t b = 0; b < currFunction->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = currFunction->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++, pos++) {
+        used.clear();
+        instrs[i].uses(used);
+        for(size_t u = 0; u < used.size(); u++) vreg_end[used[u]] = pos;
+        if(instrs[i].dst != no_vreg) {
+          vreg_start[instrs[i].dst] = vreg_end[instrs[i].dst] = pos;
+          hint[instrs[i].dst] = instrs[i].src1;
+        }
+        if(instrs[i].is_call() || instrs[i].op == ir_print || instrs[i].op == ir_new) callpos.push_back(pos);
+      }
+    }
+
+    std::vector<int> order;
+    for(int v = 0; v < n; v++) if(vreg_start[v] >= 0) order.push_back(v);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return vreg_start[a] < vreg_start[b]; });
+
+    int nspills = 0;
+    bool busy[numregs] = {false};
+    bool usedreg[numregs] = {false};
+    std::vector<int> active;
+    for(size_t k = 0; k < order.size(); k++) {
+      int v = order[k];
+
+      for(size_t a = 0; a < active.size();) {
+        if(vreg_end[active[a]] <= vreg_start[v]) { busy[vreg_reg[active[a]]] = false; active.erase(active.begin()+a); }
+        else a++;
+      }
+
+      bool crosses = false;
+      for(size_t c = 0; c < callpos.size(); c++)
+        if(vreg_start[v] < callpos[c] && callpos[c] < vreg_end[v]) crosses = true;
+      int lowest = crosses ? first_callee_saved : 0;
+
+      int r = -1;
+      if(hint[v] != no_vreg && vreg_reg[hint[v]] >= lowest && !busy[vreg_reg[hint[v]]]) r = vreg_reg[hint[v]];
+      for(int i = lowest; i < numregs && r < 0; i++) if(!busy[i]) r = i;
+
+      // Out of registers: whichever usable value is live the longest goes to memory
+      if(r < 0) {
+        int far = -1;
+        for(size_t a = 0; a < active.size(); a++)
+          if(vreg_reg[active[a]] >= lowest && (far < 0 || vreg_end[active[a]] > vreg_end[active[far]])) far = a;
+        if(far < 0 || vreg_end[active[far]] <= vreg_end[v]) { vreg_spill[v] = nspills++; continue; }
+        r = vreg_reg[active[far]];
+        vreg_reg[active[far]] = -1;
+        vreg_spill[active[far]] = nspills++;
+        active.erase(active.begin()+far);
+      }
+
+      vreg_reg[v] = r;
+      busy[r] = true;
+      usedreg[r] = true;
+      active.push_back(v);
+    }
+
+    saved.clear();
+    for(int i = first_callee_saved; i < numregs; i++) if(usedreg[i]) saved.push_back(i);
+
+    // self and the register parameters, locals, saved registers, spills
+    homes = 1 + std::min(currFunction->nparams, numargregs - 1);
+    int words = homes + currFunction->nlocals + saved.size() + nspills;
+    frameSize = (wordsize*words + 15) & ~15; // calls need %rsp 16-byte aligned
+  }
+
+  // ********** Operand helpers ********************************
+
+  static bool is_reg(const std::string &l) { return l[0] == '%'; }
+
+  static std::string mem(int offset, const std::string &base)
+  {
+    char buf[32];
+    sprintf(buf, "%d(%s)", offset, base.c_str());
+    return buf;
+  }
+
+  // Frame word k below %rbp, counting from 1
+  static std::string frame_word(int k) { return mem(-wordsize*k, "%rbp"); }
+
+  std::string save_slot(int k) { return frame_word(homes + currFunction->nlocals + 1 + k); }
+
+  std::string loc(int v)
+  {
+    if(vreg_reg[v] >= 0) return regname[vreg_reg[v]];
+    return frame_word(homes + currFunction->nlocals + saved.size() + 1 + vreg_spill[v]);
+  }
+
+  // The same location read as a 32-bit Int
+  std::string loc32(int v)
+  {
+    if(vreg_reg[v] >= 0) return regname32[vreg_reg[v]];
+    return loc(v);
+  }
+
+  // Register parameters have home slots below self, the rest stay where the caller pushed them
+  std::string frame_slot(int slot)
+  {
+    if(slot < currFunction->nparams) {
+      if(slot < numargregs - 1) return frame_word(2 + slot);
+      return mem(16 + wordsize*(slot - numargregs + 1), "%rbp");
+    }
+    return frame_word(homes + 1 + slot - currFunction->nparams);
+  }
+
+  void move(const std::string &src, const std::string &dst)
+  {
+    if(src == dst) return;
+    if(!is_reg(src) && !is_reg(dst) && src[0] != '$') {
+      fprintf( m_outputfile, "  movq %s, %%r11\n", src.c_str());
+      fprintf( m_outputfile, "  movq %%r11, %s\n", dst.c_str());
+    } else {
+      fprintf( m_outputfile, "  movq %s, %s\n", src.c_str(), dst.c_str());
+    }
+  }
+
+  std::string base_of(int v)
+  {
+    std::string o = loc(v);
+    if(is_reg(o)) return o;
+    move(o, "%r11");
+    return "%r11";
+  }
+
+  // Fill registers from sources as if every move happened at once. Sources
+  // are registers or %rbp-relative slots, so only register names can clash.
+  void parallel_move(std::vector<std::string> src, const std::vector<std::string> &dst)
+  {
+    std::vector<bool> done(src.size(), false);
+    size_t left = src.size();
+    while(left > 0) {
+      bool progress = false;
+      for(size_t i = 0; i < src.size(); i++) {
+        if(done[i]) continue;
+        bool blocked = false;
+        for(size_t j = 0; j < src.size(); j++)
+          if(!done[j] && j != i && src[j] == dst[i]) blocked = true;
+        if(blocked) continue;
+        move(src[i], dst[i]);
+        done[i] = true;
+        left--;
+        progress = true;
+      }
+      if(progress) continue;
+
+      // Every remaining move overwrites another's source: park one in the scratch register
+      for(size_t i = 0; i < src.size(); i++) {
+        if(done[i]) continue;
+        std::string d = dst[i];
+        move(d, "%r11");
+        for(size_t j = 0; j < src.size(); j++) if(!done[j] && src[j] == d) src[j] = "%r11";
+        break;
+      }
+    }
+  }
+
+  // ********** Instruction lowering ********************************
+
+  void lower_binary(IRInstr &in, const char* op, bool commutative)
+  {
+    std::string a = loc32(in.src1), b = loc32(in.src2), d = loc32(in.dst);
+    if(!is_reg(d)) {
+      fprintf( m_outputfile, "  movl %s, %%r11d\n", a.c_str());
+      fprintf( m_outputfile, "  %s %s, %%r11d\n", op, b.c_str());
+      move("%r11", loc(in.dst));
+    } else if(d == b && in.src1 != in.src2) {
+      if(commutative) fprintf( m_outputfile, "  %s %s, %s\n", op, a.c_str(), d.c_str());
+      else {
+        fprintf( m_outputfile, "  negl %s\n", d.c_str());
+        fprintf( m_outputfile, "  addl %s, %s\n", a.c_str(), d.c_str());
+      }
+    } else {
+      if(a != d) fprintf( m_outputfile, "  movl %s, %s\n", a.c_str(), d.c_str());
+      fprintf( m_outputfile, "  %s %s, %s\n", op, b.c_str(), d.c_str());
+    }
+  }
+
+  void lower_cmp(IRInstr &in)
+  {
+    std::string a = loc32(in.src1), b = loc32(in.src2);
+    if(!is_reg(a) && !is_reg(b)) {
+      fprintf( m_outputfile, "  movl %s, %%r11d\n", a.c_str());
+      a = "%r11d";
+    }
+    fprintf( m_outputfile, "  cmpl %s, %s\n", b.c_str(), a.c_str());
+  }
+
+  void lower_jcc(IRInstr &in, const char* jcc, const char* jinverse, int next_block)
+  {
+    if(in.target == next_block) fprintf( m_outputfile, "  %s %s\n", jinverse, block(in.target2).c_str());
+    else {
+      fprintf( m_outputfile, "  %s %s\n", jcc, block(in.target).c_str());
+      if(in.target2 != next_block) fprintf( m_outputfile, "  jmp %s\n", block(in.target2).c_str());
+    }
+  }
+
+  void lower_compare(IRInstr &in, const char* setcc)
+  {
+    lower_cmp(in);
+    fprintf( m_outputfile, "  %s %%r11b\n", setcc);
+    fprintf( m_outputfile, "  movzbl %%r11b, %%r11d\n");
+    move("%r11", loc(in.dst));
+  }
+
+  // %rax and %rdx are never allocated, so nothing needs saving around idiv
+  void lower_divide(IRInstr &in)
+  {
+    fprintf( m_outputfile, "  movl %s, %%eax\n", loc32(in.src1).c_str());
+    fprintf( m_outputfile, "  cltd\n"); // sign extend eax into edx
+    fprintf( m_outputfile, "  idivl %s\n", loc32(in.src2).c_str());
+    move("%rax", loc(in.dst));
+  }
+
+  void lower_unary(IRInstr &in, const char* op)
+  {
+    std::string d = loc32(in.dst);
+    if(!is_reg(d)) {
+      fprintf( m_outputfile, "  movl %s, %%r11d\n", loc32(in.src1).c_str());
+      fprintf( m_outputfile, "  %s %%r11d\n", op);
+      move("%r11", loc(in.dst));
+    } else {
+      move(loc(in.src1), loc(in.dst));
+      fprintf( m_outputfile, "  %s %s\n", op, d.c_str());
+    }
+  }
+
+  // Register arguments are filled in one parallel move; any beyond those go
+  // on the stack, last to first, padded to keep %rsp aligned
+  void lower_call(IRInstr &in)
+  {
+    int nstack = std::max(0, (int)in.args.size() - numargregs);
+    int pad = (nstack % 2) ? wordsize : 0;
+    if(pad) fprintf( m_outputfile, "  subq $%i, %%rsp\n", pad);
+    for(int i = in.args.size(); i > numargregs; i--)
+      fprintf( m_outputfile, "  pushq %s\n", loc(in.args[i-1]).c_str());
+
+    std::vector<std::string> src, dst;
+    for(size_t i = 0; i < in.args.size() && i < (size_t)numargregs; i++) {
+      src.push_back(loc(in.args[i]));
+      dst.push_back(argreg[i]);
+    }
+    parallel_move(src, dst);
+
+    if(in.op == ir_vcall) {
+      fprintf( m_outputfile, "  movq (%%rdi), %%r11\n"); // receiver's vtable
+      fprintf( m_outputfile, "  call *%s\n", mem(wordsize*in.imm, "%r11").c_str());
+    } else {
+      fprintf( m_outputfile, "  call %s\n", in.label.c_str());
+    }
+    if(nstack + pad/wordsize > 0) fprintf( m_outputfile, "  addq $%i, %%rsp\n", wordsize*nstack + pad);
+    move("%rax", loc(in.dst));
+  }
+
+  void lower_storefield(IRInstr &in)
+  {
+    int offset = wordsize*in.imm;
+    std::string o = loc(in.src1), v = loc(in.src2);
+    if(is_reg(o)) move(v, mem(offset, o));
+    else if(is_reg(v)) move(v, mem(offset, base_of(in.src1)));
+    else {
+      // both in memory: %rax is free outside of calls and division
+      move(v, "%rax");
+      move("%rax", mem(offset, base_of(in.src1)));
+    }
+  }
+
+  void epilogue()
+  {
+    for(size_t k = 0; k < saved.size(); k++)
+      fprintf( m_outputfile, "  movq %s, %s\n", save_slot(k).c_str(), regname[saved[k]]);
+    fprintf( m_outputfile, "  leave\n");
+    fprintf( m_outputfile, "  ret\n");
+  }
+
+  void lower_instr(IRInstr &in, int next_block)
+  {
+    if(m_markers) fprintf( m_outputfile, "#### %s\n", ir_opname(in.op));
+    switch(in.op) {
+      case ir_const: {
+        char imm[16];
+        sprintf(imm, "$%i", in.imm);
+        move(imm, loc(in.dst));
+        break;
+      }
+      case ir_add: lower_binary(in, "addl", true); break;
+      case ir_sub: lower_binary(in, "subl", false); break;
+      case ir_mul: lower_binary(in, "imull", true); break;
+      case ir_div: lower_divide(in); break;
+      case ir_lt: lower_compare(in, "setl"); break;
+      case ir_le: lower_compare(in, "setle"); break;
+      case ir_not: lower_unary(in, "xorl $1,"); break;
+      case ir_neg: lower_unary(in, "negl"); break;
+      case ir_shl: {
+        char op[16];
+        sprintf(op, "sall $%i,", in.imm);
+        lower_unary(in, op);
+        break;
+      }
+      case ir_self:
+        move(frame_word(1), loc(in.dst));
+        break;
+      case ir_loadlocal:
+        move(frame_slot(in.imm), loc(in.dst));
+        break;
+      case ir_storelocal:
+        move(loc(in.src1), frame_slot(in.imm));
+        break;
+      case ir_loadfield:
+        move(mem(wordsize*in.imm, base_of(in.src1)), loc(in.dst));
+        break;
+      case ir_storefield:
+        lower_storefield(in);
+        break;
+      case ir_new: {
+        // the runtime hands back zeroed memory in %rax; fill in the vtable pointer
+        fprintf( m_outputfile, "  movl $%i, %%edi\n", wordsize*in.imm);
+        fprintf( m_outputfile, "  call %s\n", allocFun);
+        fprintf( m_outputfile, "  leaq %s(%%rip), %%r11\n", in.label.c_str());
+        fprintf( m_outputfile, "  movq %%r11, (%%rax)\n");
+        move("%rax", loc(in.dst));
+        break;
+      }
+      case ir_framenew:
+        // field 0 sits in the highest-numbered slot, which is the lowest address
+        fprintf( m_outputfile, "  leaq %s, %%r11\n", frame_slot(in.imm).c_str());
+        fprintf( m_outputfile, "  leaq %s(%%rip), %%rax\n", in.label.c_str());
+        fprintf( m_outputfile, "  movq %%rax, (%%r11)\n");
+        move("%r11", loc(in.dst));
+        break;
+      case ir_call:
+      case ir_vcall:
+        lower_call(in);
+        break;
+      case ir_print:
+        fprintf( m_outputfile, "  movl %s, %%edi\n", loc32(in.src1).c_str());
+        fprintf( m_outputfile, "  call %s\n", printFun);
+        break;
+      case ir_jump:
+        if(in.target != next_block) fprintf( m_outputfile, "  jmp %s\n", block(in.target).c_str());
+        break;
+      case ir_branch:
+        fprintf( m_outputfile, "  cmpl $0, %s\n", loc32(in.src1).c_str());
+        lower_jcc(in, "jne", "je", next_block);
+        break;
+      case ir_blt:
+        lower_cmp(in);
+        lower_jcc(in, "jl", "jge", next_block);
+        break;
+      case ir_ble:
+        lower_cmp(in);
+        lower_jcc(in, "jle", "jg", next_block);
+        break;
+      case ir_ret:
+        if(in.src1 != no_vreg) move(loc(in.src1), "%rax");
+        epilogue();
+        break;
+      default:
+        assert(0);
+    }
+  }
+
+  void lower(IRFunction *f)
+  {
+    currFunction = f;
+    linear_scan();
+
+    if(m_markers) fprintf(m_outputfile, "######## METHOD\n");
+    fprintf(m_outputfile, "%s:\n", f->name.c_str());
+
+    // Prologue - frame, callee-saved registers, then the register arguments to their home slots
+    fprintf(m_outputfile, "  pushq %%rbp\n");
+    fprintf(m_outputfile, "  movq %%rsp, %%rbp\n");
+    if(frameSize > 0) fprintf(m_outputfile, "  subq $%i, %%rsp\n", frameSize);
+    for(size_t k = 0; k < saved.size(); k++)
+      fprintf(m_outputfile, "  movq %s, %s\n", regname[saved[k]], save_slot(k).c_str());
+    for(int k = 0; k < homes; k++)
+      fprintf(m_outputfile, "  movq %s, %s\n", argreg[k], frame_word(1 + k).c_str());
+
+    for(size_t b = 0; b < f->blocks.size(); b++) {
+      if(b > 0) fprintf(m_outputfile, "%s:\n", block(b).c_str());
+      std::vector<IRInstr> &instrs = f->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++)
+        lower_instr(instrs[i], b+1);
+    }
+    if(m_markers) fprintf(m_outputfile, "########\n");
+    fprintf(m_outputfile, "\n");
+  }
+
+  // functions[first..last) as assembly text; taken from the cache if they
+  // are a whole class that was lowered the same way before
+  void lower_range(IRProgram *program, size_t first, size_t last, std::string &text)
+  {
+    std::string key;
+    if(m_cache != NULL) {
+      key = m_cache->asm_key(std::string("x86-64") + (m_markers ? " markers" : ""), program, first, last);
+      if(m_cache->find(key, text)) {
+        m_cache->hits++;
+        return;
+      }
+      m_cache->misses++;
+    }
+    FILE* out = m_outputfile;
+    char* buf = NULL;
+    size_t len = 0;
+    m_outputfile = open_memstream(&buf, &len);
+    for(size_t i = first; i < last; i++) lower(program->functions[i]);
+    fclose(m_outputfile);
+    m_outputfile = out;
+    text.assign(buf, len);
+    free(buf);
+    if(m_cache != NULL) m_cache->store(key, text);
+  }
+
+  // Every function, on m_jobs threads. Each thread lowers with a Codegen of
+  // its own, since lowering keeps per-function state in the object, and
+  // block labels are named after their function, so no two pieces of work
+  // share anything. The pieces are written out in program order whichever
+  // finished first, so the output is the same for any number of jobs.
+  void lower_all(IRProgram *program)
+  {
+    // a class's methods are next to each other, and the cache keeps whole
+    // classes; without one, each method is a piece of work on its own
+    std::vector<IRFunction*> &fns = program->functions;
+    std::vector<std::pair<size_t, size_t> > units;
+    for(size_t i = 0, j; i < fns.size(); i = j) {
+      for(j = i + 1; j < fns.size() && fns[j]->cls == fns[i]->cls; j++) ;
+      if(m_cache != NULL) units.push_back(std::make_pair(i, j));
+      else for(size_t k = i; k < j; k++) units.push_back(std::make_pair(k, k + 1));
+    }
+
+    std::vector<Codegen64*> workers(1, this);
+    for(int t = 1; t < m_jobs && t < (int)units.size(); t++) workers.push_back(new Codegen64(NULL, m_markers, m_cache));
+    std::vector<std::string> texts(units.size());
+    parallel_for(units.size(), workers.size(), [&](int t, size_t u) {
+      workers[t]->lower_range(program, units[u].first, units[u].second, texts[u]);
+    });
+    for(size_t t = 1; t < workers.size(); t++) {
+      delete workers[t];
+    }
+
+    for(size_t u = 0; u < texts.size(); u++) fwrite(texts[u].data(), 1, texts[u].size(), m_outputfile);
+  }
+
+  void init()
+  {
+    fprintf( m_outputfile, ".text\n\n");
+
+    fprintf( m_outputfile, ".section .rodata\n");
+    fprintf( m_outputfile, "%s:\n", printFormat);
+    fprintf( m_outputfile, "       .string \"%%d\\n\"\n");
+    fprintf( m_outputfile, "       .text\n");
+    fprintf( m_outputfile, "       .globl  %s\n",printFun);
+    fprintf( m_outputfile, "       .type   %s, @function\n\n",printFun);
+    fprintf( m_outputfile, "%s:\n",printFun);
+    fprintf( m_outputfile, "       pushq   %%rbp\n");
+    fprintf( m_outputfile, "       movq    %%rsp, %%rbp\n");
+    fprintf( m_outputfile, "       movl    %%edi, %%esi\n");
+    fprintf( m_outputfile, "       leaq    %s(%%rip), %%rdi\n", printFormat);
+    fprintf( m_outputfile, "       movl    $0, %%eax\n"); // no vector registers for varargs
+    fprintf( m_outputfile, "       call    printf@PLT\n");
+    fprintf( m_outputfile, "       leave\n");
+    fprintf( m_outputfile, "       ret\n\n");
+  }
+
+  // Program_start saves whatever callee-saved registers it uses, so Start
+  // does not have to
+  void start(int programSize)
+  {
+    fprintf( m_outputfile, "# Start Function\n");
+    fprintf( m_outputfile, ".global Start\n");
+    fprintf( m_outputfile, "Start:\n");
+    fprintf( m_outputfile, "        pushq   %%rbp\n");
+    fprintf( m_outputfile, "        movq    %%rsp, %%rbp\n");
+    fprintf( m_outputfile, "        movl    $%d, %%edi\n",programSize);
+    fprintf( m_outputfile, "        call    %s\n",allocFun);
+    fprintf( m_outputfile, "        leaq    Program_vtable(%%rip), %%r11\n");
+    fprintf( m_outputfile, "        movq    %%r11, (%%rax)\n");
+    fprintf( m_outputfile, "        movq    %%rax, %%rdi\n");
+    fprintf( m_outputfile, "        call    Program_start\n");
+    fprintf( m_outputfile, "        leave\n");
+    fprintf( m_outputfile, "        ret\n");
+  }
+
+  // Vtables hold absolute addresses, so they go where the loader can relocate them
+  void vtables(IRProgram *program)
+  {
+    fprintf( m_outputfile, "\n# Virtual Method Tables\n");
+    fprintf( m_outputfile, ".section .data.rel.ro,\"aw\"\n");
+    fprintf( m_outputfile, ".align 8\n");
+    for(size_t i = 0; i < program->classes.size(); i++) {
+      IRClass* c = program->classes[i];
+      fprintf( m_outputfile, "%s:\n", c->vtable_label().c_str());
+      for(size_t s = 0; s < c->vtable.size(); s++)
+        fprintf( m_outputfile, "        .quad   %s\n", c->vtable[s].c_str());
+    }
+    fprintf( m_outputfile, ".section .note.GNU-stack,\"\",@progbits\n");
+  }
+
+////////////////////////////////////////////////////////////////////////////////
+public:
+
+  long emitted;   // assembly instructions written
+
+  Codegen64(FILE * outputfile, bool markers = true, CompileCache* cache = NULL, int jobs = 1)
+  {
+    m_outputfile = outputfile;
+    m_cache = cache;
+    m_jobs = jobs;
+    m_markers = markers;
+    emitted = 0;
+    currFunction = NULL;
+    homes = 0;
+    frameSize = 0;
+  }
+  //=====================================================================================================================
+  void generate(IRProgram *program) {
+
+    // everything goes out in one write at the end
+    FILE* out = m_outputfile;
+    AsmBuffer buffer(out);
+    m_outputfile = buffer.stream();
+
+    init();
+
+    if(m_jobs > 1 || m_cache != NULL) lower_all(program);
+    else {
+      for(size_t i = 0; i < program->functions.size(); i++)
+        lower(program->functions[i]);
+    }
+
+    start(program->programSize*wordsize);
+
+    vtables(program);
+
+    buffer.flush();
+    emitted = buffer.instructions();
+    m_outputfile = out;
+  }
+};
@@ -0,0 +1,143 @@
+#include "compilecache.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+// FNV-1a, 64 bits
+static unsigned long long hash(const char* s, size_t len)
+{
+	unsigned long long h = 14695981039346656037ull;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/****** CompileCache Implementation **************************************/
+
+CompileCache::CompileCache(const char* dir, long limit)
+{
+	m_dir = dir;
+	m_limit = limit;
+	m_stored = false;
+	hits = 0;
+	misses = 0;
+	ir_hits = 0;
+	ir_misses = 0;
+	mkdir(dir, 0777); // already there is fine; a real failure shows up as misses
+
+	// any rebuild of the compiler changes its size or time, and might change
+	// the code it generates
+	struct stat st;
+	char buf[64];
+	if(stat("/proc/self/exe", &st) == 0)
+		snprintf(buf, sizeof(buf), "%lld.%lld", (long long)st.st_size, (long long)st.st_mtime);
+	else
+		snprintf(buf, sizeof(buf), "%s %s", __DATE__, __TIME__);
+	m_compiler = buf;
+}
+
+// the length makes an accidental collision that much less likely
+std::string CompileCache::digest(const char* s, size_t len)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx-%zx", hash(s, len), len);
+	return name;
+}
+
+std::string CompileCache::ir_key(const std::string &config, const std::string &interfaces, const std::string &source)
+{
+	std::string text = m_compiler + "\n" + config + "\n" + interfaces + "\n" + source;
+	return digest(text.data(), text.size()) + ".ir";
+}
+
+std::string CompileCache::asm_key(const std::string &config, IRProgram* program, size_t first, size_t last)
+{
+	char* buf = NULL;
+	size_t len = 0;
+	FILE* f = open_memstream(&buf, &len);
+	fprintf(f, "%s\n%s\n", m_compiler.c_str(), config.c_str());
+	for(size_t i = first; i < last; i++) program->functions[i]->dump(f);
+	fclose(f);
+	std::string name = digest(buf, len) + ".s";
+	free(buf);
+	return name;
+}
+
+std::string CompileCache::path(const std::string &key) const
+{
+	return m_dir + "/" + key;
+}
+
+bool CompileCache::find(const std::string &key, std::string &text)
+{
+	FILE* f = fopen(path(key).c_str(), "r");
+	if(f == NULL) return false;
+	text.clear();
+	char buf[8192];
+	size_t n;
+	while((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+	bool ok = !ferror(f);
+	fclose(f);
+	// a hit is a use, which the sweep goes by
+	if(ok) utime(path(key).c_str(), NULL);
+	return ok;
+}
+
+// Written under a temporary name and renamed into place, so a compile
+// running at the same time never reads half a file
+void CompileCache::store(const std::string &key, const std::string &text)
+{
+	std::string final_path = path(key);
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+	std::string tmp = final_path + suffix;
+
+	FILE* f = fopen(tmp.c_str(), "w");
+	if(f == NULL) return;
+	bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+	ok = fclose(f) == 0 && ok;
+	if(!ok || rename(tmp.c_str(), final_path.c_str()) != 0) unlink(tmp.c_str());
+	else m_stored = true;
+}
+
+static bool ends_with(const std::string &s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Entries are used (found or stored) in the order of their modification
+// times, so the oldest go first. Temporary files of stores in progress are
+// left alone.
+void CompileCache::sweep()
+{
+	if(!m_stored) return;
+	DIR* d = opendir(m_dir.c_str());
+	if(d == NULL) return;
+	struct Entry { time_t used; long size; std::string name; };
+	std::vector<Entry> entries;
+	long total = 0;
+	struct dirent* e;
+	while((e = readdir(d)) != NULL) {
+		std::string name = e->d_name;
+		struct stat st;
+		if(!ends_with(name, ".ir") && !ends_with(name, ".s")) continue;
+		if(stat(path(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		Entry entry = { st.st_mtime, (long)st.st_size, name };
+		entries.push_back(entry);
+		total += st.st_size;
+	}
+	closedir(d);
+	if(total <= m_limit) return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+	for(size_t i = 0; i < entries.size() && total > m_limit; i++)
+		if(unlink(path(entries[i].name).c_str()) == 0) total -= entries[i].size;
+}
@@ -0,0 +1,91 @@
+#ifndef COMPILECACHE_HPP
+#define COMPILECACHE_HPP
+
+#include "ir.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Work from earlier compiles, one file per class in a cache directory, kept
+// at two points of the pipeline.
+//
+// A class's IR as IRGen produced it is looked up, before typechecking, by a
+// hash of the class's source text, of the interfaces (names, superclass,
+// fields and method signatures) of every class before it, of the front end
+// options and of the compiler binary itself. A class can only use classes
+// defined before it, so those are everything its typechecking, folding and
+// IR depend on: inherited field offsets and vtable slots, and the sizes and
+// slots of the classes it allocates and calls, all follow from the
+// interfaces. When the IR is found, typechecking only reads the class's
+// fields and method headers, folding skips it, and IRGen lays the class out
+// and takes its methods from the cache.
+//
+// A class's assembly is looked up by a hash of its methods' IR after the IR
+// passes, the backend and its options, and the compiler binary. This key is
+// the IR rather than the source because devirtualization, inlining and
+// escape analysis make a class's code depend on others: a subclass that
+// starts overriding a method changes its callers, and that change shows in
+// their IR but not in their source.
+//
+// Every use of an entry marks it as recently used, and once a compile has
+// added entries, sweep() deletes the least recently used ones until the
+// directory is back under its size limit.
+//
+// Any number of threads may look up and store classes at once.
+class CompileCache
+{
+  public:
+	// dir is created if it does not exist; limit is in bytes
+	CompileCache(const char* dir, long limit);
+
+	// A hash of len bytes at s, as text to build keys from
+	static std::string digest(const char* s, size_t len);
+
+	// The key of a class's IR. interfaces digests the interfaces of the
+	// classes before it, and source its text.
+	std::string ir_key(const std::string &config, const std::string &interfaces, const std::string &source);
+
+	// The key of the methods functions[first..last) of program, which all
+	// belong to one class, as lowered by the backend described by config
+	std::string asm_key(const std::string &config, IRProgram* program, size_t first, size_t last);
+
+	// The entry stored under key, if there is any
+	bool find(const std::string &key, std::string &text);
+	void store(const std::string &key, const std::string &text);
+
+	// Delete the least recently used entries until the directory holds no
+	// more than the limit; does nothing unless something was stored
+	void sweep();
+
+	// codegen threads share one cache
+	std::atomic<long> hits;     // classes whose assembly was found
+	std::atomic<long> misses;   // classes that had to be lowered
+	long ir_hits;               // classes whose IR was found
+	long ir_misses;             // classes that went through the front end
+
+  private:
+	std::string m_dir;
+	std::string m_compiler;   // identifies the compiler binary
+	long m_limit;
+	std::atomic<bool> m_stored;
+
+	std::string path(const std::string &key) const;
+};
+
+// The front end's use of the cache in one compile: for each class, in
+// program order, the key of its IR and the IR itself if an earlier compile
+// stored it. Typecheck fills it in and ConstFold and IRGen follow it.
+struct CachedClasses
+{
+	CompileCache* cache;
+	std::string config;                 // the front end options
+	std::vector<std::string> sources;   // digest of each class's source text
+	std::vector<std::string> keys;
+	std::vector<std::string> ir;        // empty where the class was not found
+
+	CachedClasses(CompileCache* c, const std::string &conf) : cache(c), config(conf) {}
+
+	bool hit(size_t k) const { return k < ir.size() && !ir[k].empty(); }
+};
+
+#endif //COMPILECACHE_HPP
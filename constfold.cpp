@@ -0,0 +1,346 @@
+#include "ast.hpp"
+#include "primitive.hpp"
+#include "arena.hpp"
+#include "astcast.hpp"
+#include "compilecache.hpp"
+#include <stdio.h>
+#include <limits.h>
+
+// Folds constant subexpressions and applies algebraic identities to the typed
+// AST, between Typecheck and code generation. If statements whose predicate
+// folds to a constant are replaced by their body or dropped.
+//
+// Expressions are only ever removed when they cannot have side effects, that
+// is when they contain no method call and no division that might trap.
+//
+// Classes whose IR was found in the cache are left as they are, since IRGen
+// will not look at their methods.
+class ConstFold : public Visitor {
+    private:
+    const CachedClasses* m_cached;  // NULL if there is no cache
+
+    Expression* m_expr;     // folded replacement for the last expression visited
+    bool m_pure;            // whether m_expr is free of side effects
+    Statement* m_stmt;      // replacement for the last statement visited, NULL to drop it
+
+    //=====================================================================================================================
+
+    Expression* fold(Expression* e, bool &pure) {
+        e->accept(this);
+        pure = m_pure;
+        return m_expr;
+    }
+
+    Expression* fold(Expression* e) {
+        bool pure;
+        return fold(e, pure);
+    }
+
+    bool int_value(Expression* e, int &v) {
+        IntegerLiteral* lit = expr_cast<IntegerLiteral>(e);
+        if(lit == NULL) return false;
+        v = lit->m_primitive->m_data;
+        return true;
+    }
+
+    bool bool_value(Expression* e, int &v) {
+        BooleanLiteral* lit = expr_cast<BooleanLiteral>(e);
+        if(lit == NULL) return false;
+        v = lit->m_primitive->m_data;
+        return true;
+    }
+
+    // New literals take the place (and line number) of the folded expression,
+    // and live in the arena with the rest of the tree
+    Expression* int_literal(int v, Expression* at) {
+        IntegerLiteral* lit = new(compile_arena) IntegerLiteral(new(compile_arena) Primitive(v));
+        lit->m_attribute.m_type.baseType = bt_integer;
+        lit->m_attribute.lineno = at->m_attribute.lineno;
+        m_pure = true;
+        return lit;
+    }
+
+    Expression* bool_literal(int v, Expression* at) {
+        BooleanLiteral* lit = new(compile_arena) BooleanLiteral(new(compile_arena) Primitive(v ? 1 : 0));
+        lit->m_attribute.m_type.baseType = bt_boolean;
+        lit->m_attribute.lineno = at->m_attribute.lineno;
+        m_pure = true;
+        return lit;
+    }
+
+    // Int arithmetic wraps around like the machine does
+    static int wrap(long long v) { return (int)(unsigned int)(unsigned long long)v; }
+
+    void fold_list(list<Expression_ptr>* l) {
+        Items<Expression_ptr>& a = items_of(l);
+        bool changed = false;
+        for(size_t k = 0; k < a.size(); k++) {
+            Expression* e = fold(a[k]);
+            changed |= e != a[k];
+            a[k] = e;
+        }
+        if(changed) store_items(l);
+    }
+
+    // Folds a statement; returns its replacement or NULL if it is gone
+    Statement* fold_statement(Statement* s) {
+        m_stmt = s;
+        s->accept(this);
+        return m_stmt;
+    }
+
+    public:
+
+    ConstFold(const CachedClasses* cached) {
+        m_cached = cached;
+        m_expr = NULL;
+        m_pure = true;
+        m_stmt = NULL;
+    }
+
+    //=====================================================================================================================
+
+    void visitProgramImpl(ProgramImpl *p) {
+        Items<Class_ptr>& l = items_of(p->m_class_list);
+        for(size_t k = 0; k < l.size(); k++)
+            if(m_cached == NULL || !m_cached->hit(k)) l[k]->accept(this);
+    }
+    void visitClassImpl(ClassImpl *p) { visit_items(p->m_method_list, this); } // declarations have nothing to fold
+    void visitDeclarationImpl(DeclarationImpl *p) {}
+    void visitMethodImpl(MethodImpl *p) { p->m_methodbody->accept(this); }
+    void visitParameterImpl(ParameterImpl *p) {}
+
+    //=====================================================================================================================
+
+    void visitMethodBodyImpl(MethodBodyImpl *p) {
+
+        // Fold each statement, splicing in replacements and dropping dead ones
+        Items<Statement_ptr>& a = items_of(p->m_statement_list);
+        size_t n = 0;
+        bool changed = false;
+        for(size_t k = 0; k < a.size(); k++) {
+            Statement* s = fold_statement(a[k]);
+            changed |= s != a[k];
+            if(s != NULL) a[n++] = s;
+        }
+        a.n = n;
+        if(changed) store_items(p->m_statement_list);
+
+        p->m_return->accept(this);
+    }
+
+    //=====================================================================================================================
+
+    void visitAssignment(Assignment *p) {
+        p->m_expression = fold(p->m_expression);
+    }
+
+    //=====================================================================================================================
+
+    void visitIf(If *p) {
+
+        bool pure;
+        p->m_expression = fold(p->m_expression, pure);
+        Statement* body = fold_statement(p->m_statement);
+
+        int v;
+        if(bool_value(p->m_expression, v)) {
+            m_stmt = v ? body : NULL;
+        } else if(body == NULL) {
+            // the body folded away; the predicate still has to run if it calls anything
+            m_stmt = pure ? NULL : p;
+        } else {
+            p->m_statement = body;
+            m_stmt = p;
+        }
+    }
+
+    //=====================================================================================================================
+
+    void visitPrint(Print *p) {
+        p->m_expression = fold(p->m_expression);
+    }
+
+    //=====================================================================================================================
+
+    void visitReturnImpl(ReturnImpl *p) {
+        if(p->m_expression != NULL) p->m_expression = fold(p->m_expression);
+    }
+
+    //=====================================================================================================================
+
+    void visitTInteger(TInteger *p) {}
+    void visitTBoolean(TBoolean *p) {}
+    void visitTNothing(TNothing *p) {}
+    void visitTObject(TObject *p) {}
+    void visitClassIDImpl(ClassIDImpl *p) {}
+    void visitVariableIDImpl(VariableIDImpl *p) {}
+    void visitMethodIDImpl(MethodIDImpl *p) {}
+
+    //=====================================================================================================================
+
+    void visitPlus(Plus *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        bool c1 = int_value(p->m_expression_1, a), c2 = int_value(p->m_expression_2, b);
+        if(c1 && c2) m_expr = int_literal(wrap((long long)a + b), p);
+        else if(c1 && a == 0) m_expr = p->m_expression_2;           // 0 + x
+        else if(c2 && b == 0) m_expr = p->m_expression_1;           // x + 0
+    }
+
+    //=====================================================================================================================
+
+    void visitMinus(Minus *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        bool c1 = int_value(p->m_expression_1, a), c2 = int_value(p->m_expression_2, b);
+        if(c1 && c2) m_expr = int_literal(wrap((long long)a - b), p);
+        else if(c2 && b == 0) m_expr = p->m_expression_1;           // x - 0
+    }
+
+    //=====================================================================================================================
+
+    void visitTimes(Times *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        bool c1 = int_value(p->m_expression_1, a), c2 = int_value(p->m_expression_2, b);
+        if(c1 && c2) m_expr = int_literal(wrap((long long)a * b), p);
+        else if(c1 && a == 1) m_expr = p->m_expression_2;           // 1 * x
+        else if(c2 && b == 1) m_expr = p->m_expression_1;           // x * 1
+        else if(c1 && a == 0 && pure2) m_expr = int_literal(0, p);  // 0 * x
+        else if(c2 && b == 0 && pure1) m_expr = int_literal(0, p);  // x * 0
+        // multiplying by a power of two becomes a shift when the IR is built;
+        // IRGen only does that when this pass is on
+    }
+
+    //=====================================================================================================================
+
+    void visitDivide(Divide *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        // division by zero and INT_MIN / -1 are left to trap at run time, so a
+        // division only counts as pure when the divisor is known to be safe
+        int a, b;
+        bool c1 = int_value(p->m_expression_1, a), c2 = int_value(p->m_expression_2, b);
+        if(!c2 || b == 0 || b == -1) m_pure = false;
+        if(c1 && c2 && b != 0 && !(a == INT_MIN && b == -1)) m_expr = int_literal(a / b, p);
+        else if(c2 && b == 1) m_expr = p->m_expression_1;           // x / 1
+    }
+
+    //=====================================================================================================================
+
+    void visitAnd(And *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        bool c1 = bool_value(p->m_expression_1, a), c2 = bool_value(p->m_expression_2, b);
+        if(c1 && c2) m_expr = bool_literal(a && b, p);
+        else if(c1 && a) m_expr = p->m_expression_2;                // true and x
+        else if(c2 && b) m_expr = p->m_expression_1;                // x and true
+        else if(c1 && !a) { m_expr = bool_literal(0, p); m_pure = true; } // false and x: x never runs
+        else if(c2 && !b && pure1) m_expr = bool_literal(0, p);     // x and false
+    }
+
+    //=====================================================================================================================
+
+    void visitLessThan(LessThan *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        if(int_value(p->m_expression_1, a) && int_value(p->m_expression_2, b)) m_expr = bool_literal(a < b, p);
+    }
+
+    //=====================================================================================================================
+
+    void visitLessThanEqualTo(LessThanEqualTo *p) {
+
+        bool pure1, pure2;
+        p->m_expression_1 = fold(p->m_expression_1, pure1);
+        p->m_expression_2 = fold(p->m_expression_2, pure2);
+        m_expr = p; m_pure = pure1 && pure2;
+
+        int a, b;
+        if(int_value(p->m_expression_1, a) && int_value(p->m_expression_2, b)) m_expr = bool_literal(a <= b, p);
+    }
+
+    //=====================================================================================================================
+
+    void visitNot(Not *p) {
+
+        p->m_expression = fold(p->m_expression, m_pure);
+        m_expr = p;
+
+        int a;
+        Not* inner = expr_cast<Not>(p->m_expression);
+        if(bool_value(p->m_expression, a)) m_expr = bool_literal(!a, p);
+        else if(inner != NULL) m_expr = inner->m_expression;        // not not x
+    }
+
+    //=====================================================================================================================
+
+    void visitUnaryMinus(UnaryMinus *p) {
+
+        p->m_expression = fold(p->m_expression, m_pure);
+        m_expr = p;
+
+        int a;
+        UnaryMinus* inner = expr_cast<UnaryMinus>(p->m_expression);
+        if(int_value(p->m_expression, a)) m_expr = int_literal(wrap(-(long long)a), p);
+        else if(inner != NULL) m_expr = inner->m_expression;        // - - x
+    }
+
+    //=====================================================================================================================
+
+    void visitMethodCall(MethodCall *p) {
+        fold_list(p->m_expression_list);
+        m_expr = p; m_pure = false;
+    }
+
+    //=====================================================================================================================
+
+    void visitSelfCall(SelfCall *p) {
+        fold_list(p->m_expression_list);
+        m_expr = p; m_pure = false;
+    }
+
+    //=====================================================================================================================
+
+    void visitVariable(Variable *p) { m_expr = p; m_pure = true; }
+    void visitIntegerLiteral(IntegerLiteral *p) { m_expr = p; m_pure = true; }
+    void visitBooleanLiteral(BooleanLiteral *p) { m_expr = p; m_pure = true; }
+    void visitNothing(Nothing *p) { m_expr = p; m_pure = true; }
+
+    //=====================================================================================================================
+
+    void visitSymName(SymName *p) {}
+    void visitPrimitive(Primitive *p) {}
+    void visitClassName(ClassName *p) {}
+    void visitNullPointer() {}
+};
@@ -0,0 +1,66 @@
+#include "ir.hpp"
+#include "assert.h"
+#include <stdio.h>
+#include <vector>
+
+// Turns virtual calls back into direct ones when no subclass of the
+// receiver's static class overrides the method being called. This has to
+// wait until the whole program has been lowered, since subclasses are
+// declared after the classes they extend.
+class Devirtualize
+{
+  private:
+
+  IRProgram *m_program;
+
+  // overridden[c][s] is set when some subclass of class c puts a different
+  // function in vtable slot s
+  std::vector<std::vector<bool> > overridden;
+
+  void find_overrides()
+  {
+    std::vector<IRClass*> &classes = m_program->classes;
+    overridden.resize(classes.size());
+    for(size_t c = 0; c < classes.size(); c++)
+      overridden[c].assign(classes[c]->vtable.size(), false);
+
+    for(size_t c = 0; c < classes.size(); c++) {
+      for(int a = classes[c]->super; a >= 0; a = classes[a]->super) {
+        for(size_t s = 0; s < classes[a]->vtable.size(); s++)
+          if(classes[c]->vtable[s] != classes[a]->vtable[s]) overridden[a][s] = true;
+      }
+    }
+  }
+
+  public:
+
+  int devirtualized;   // calls made direct
+  int remaining;       // calls that still go through a vtable
+
+  Devirtualize(IRProgram *program)
+  {
+    m_program = program;
+    devirtualized = remaining = 0;
+  }
+
+  void run()
+  {
+    find_overrides();
+
+    for(size_t f = 0; f < m_program->functions.size(); f++) {
+      IRFunction* fn = m_program->functions[f];
+      for(size_t b = 0; b < fn->blocks.size(); b++) {
+        std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+        for(size_t i = 0; i < instrs.size(); i++) {
+          IRInstr &in = instrs[i];
+          if(in.op != ir_vcall) continue;
+          assert(in.cls >= 0 && in.imm < (int)overridden[in.cls].size());
+          if(overridden[in.cls][in.imm]) { remaining++; continue; }
+          // the label already names the static target
+          in.op = ir_call;
+          devirtualized++;
+        }
+      }
+    }
+  }
+};
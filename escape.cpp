@@ -0,0 +1,249 @@
+#include "ir.hpp"
+#include "assert.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+// Finds objects created by a method that cannot outlive the call that
+// created them, and takes them off the heap. An object escapes when it is
+// stored into a field, returned, printed, compared, stored into a second
+// variable, or passed to a call that might keep it. Runs after inlining,
+// which removes most of the calls an object is passed to.
+//
+// An object that is only used through its fields is scalar replaced: each
+// field becomes a frame slot of its own and the object is never built. One
+// that is also passed to callees which only look at its fields is laid out
+// in the caller's frame instead of the heap.
+class EscapeAnalysis
+{
+  private:
+
+  IRProgram *m_program;
+
+  std::map<std::string, IRFunction*> m_functions;
+
+  // escapes[fn][a] is set when argument a of fn (0 is the receiver) may be
+  // kept past the end of the call
+  std::map<IRFunction*, std::vector<bool> > m_escapes;
+
+  enum Fate { fields_only, passed, escapes };
+
+  // ********** Helper functions ********************************
+
+  IRFunction* callee_of(const IRInstr &in)
+  {
+    std::map<std::string, IRFunction*>::iterator it = m_functions.find(in.label);
+    return it == m_functions.end() ? NULL : it->second;
+  }
+
+  // The virtual registers that hold whatever was stored in slot, or the
+  // receiver when slot is -1
+  void loads_of(IRFunction* fn, int slot, std::set<int> &vals)
+  {
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        if(slot < 0 && instrs[i].op == ir_self) vals.insert(instrs[i].dst);
+        if(slot >= 0 && instrs[i].op == ir_loadlocal && instrs[i].imm == slot) vals.insert(instrs[i].dst);
+      }
+    }
+  }
+
+  int stores_to(IRFunction* fn, int slot)
+  {
+    int n = 0;
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++)
+        if(instrs[i].op == ir_storelocal && instrs[i].imm == slot) n++;
+    }
+    return n;
+  }
+
+  // How an object held in vals is used in fn; home is the one slot it may
+  // be stored in
+  Fate fate(IRFunction* fn, const std::set<int> &vals, int home)
+  {
+    Fate f = fields_only;
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        IRInstr &in = instrs[i];
+        std::vector<int> used;
+        in.uses(used);
+        bool mentioned = false;
+        for(size_t u = 0; u < used.size(); u++) if(vals.count(used[u])) mentioned = true;
+        if(!mentioned) continue;
+
+        switch(in.op) {
+          case ir_loadfield:
+            if(in.imm == 0) f = passed; // the vtable pointer only exists in a real object
+            break;
+          case ir_storefield:
+            if(vals.count(in.src2)) return escapes;
+            if(in.imm == 0) f = passed;
+            break;
+          case ir_storelocal:
+            if(in.imm != home) return escapes;
+            break;
+          case ir_call: {
+            IRFunction* callee = callee_of(in);
+            if(callee == NULL) return escapes;
+            for(size_t a = 0; a < in.args.size(); a++)
+              if(vals.count(in.args[a]) && m_escapes[callee][a]) return escapes;
+            f = passed;
+            break;
+          }
+          default:
+            return escapes;
+        }
+      }
+    }
+    return f;
+  }
+
+  // Which arguments each function may keep. Starts from keeping none and
+  // marks more until nothing changes, so recursion settles on the smallest
+  // consistent answer.
+  void summarize()
+  {
+    std::vector<IRFunction*> &functions = m_program->functions;
+    for(size_t f = 0; f < functions.size(); f++)
+      m_escapes[functions[f]].assign(functions[f]->nparams + 1, false);
+
+    bool changed = true;
+    while(changed) {
+      changed = false;
+      for(size_t f = 0; f < functions.size(); f++) {
+        IRFunction* fn = functions[f];
+        for(int a = 0; a <= fn->nparams; a++) {
+          if(m_escapes[fn][a]) continue;
+          std::set<int> vals;
+          loads_of(fn, a - 1, vals);
+          if(fate(fn, vals, -1) == escapes) {
+            m_escapes[fn][a] = true;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Give each field of the object made by alloc a slot of its own, and turn
+  // field accesses into slot accesses
+  void scalar_replace(IRFunction* fn, const IRInstr &alloc, int home, const std::set<int> &vals)
+  {
+    std::vector<int> field(alloc.imm, -1);
+    for(int k = 1; k < alloc.imm; k++) field[k] = fn->new_local();
+
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> instrs;
+      instrs.swap(fn->blocks[b]->instrs);
+      std::vector<IRInstr> &out = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        IRInstr in = instrs[i];
+        if(in.op == ir_new && in.dst == alloc.dst) {
+          // fresh objects start out zeroed
+          IRInstr zero(ir_const);
+          zero.dst = in.dst;
+          out.push_back(zero);
+          for(int k = 1; k < alloc.imm; k++) {
+            IRInstr st(ir_storelocal);
+            st.src1 = zero.dst;
+            st.imm = field[k];
+            out.push_back(st);
+          }
+          continue;
+        }
+        if((in.op == ir_storelocal || in.op == ir_loadlocal) && in.imm == home) continue;
+        if(in.op == ir_loadfield && vals.count(in.src1)) {
+          IRInstr ld(ir_loadlocal);
+          ld.dst = in.dst;
+          ld.imm = field[in.imm];
+          in = ld;
+        }
+        else if(in.op == ir_storefield && vals.count(in.src1)) {
+          IRInstr st(ir_storelocal);
+          st.src1 = in.src2;
+          st.imm = field[in.imm];
+          in = st;
+        }
+        out.push_back(in);
+      }
+    }
+  }
+
+  // Lay the object made by alloc out over fresh frame slots
+  void frame_allocate(IRFunction* fn, IRInstr &alloc, std::vector<IRInstr> &instrs, size_t i)
+  {
+    int base = fn->new_local();
+    for(int k = 1; k < alloc.imm; k++) base = fn->new_local();
+    alloc.op = ir_framenew;
+    int words = alloc.imm;
+    alloc.imm = base;
+
+    std::vector<IRInstr> init;
+    IRInstr zero(ir_const);
+    zero.dst = fn->new_vreg();
+    init.push_back(zero);
+    for(int k = 1; k < words; k++) {
+      IRInstr st(ir_storelocal);
+      st.src1 = zero.dst;
+      st.imm = base - k;
+      init.push_back(st);
+    }
+    instrs.insert(instrs.begin() + i + 1, init.begin(), init.end());
+  }
+
+  public:
+
+  int scalar_replaced;   // objects turned into frame slots
+  int frame_allocated;   // objects moved from the heap to the frame
+
+  EscapeAnalysis(IRProgram *program)
+  {
+    m_program = program;
+    scalar_replaced = frame_allocated = 0;
+    for(size_t f = 0; f < program->functions.size(); f++)
+      m_functions[program->functions[f]->name] = program->functions[f];
+  }
+
+  void run()
+  {
+    summarize();
+
+    for(size_t f = 0; f < m_program->functions.size(); f++) {
+      IRFunction* fn = m_program->functions[f];
+      for(size_t b = 0; b < fn->blocks.size(); b++) {
+        for(size_t i = 0; i < fn->blocks[b]->instrs.size(); i++) {
+          IRInstr alloc = fn->blocks[b]->instrs[i];
+          if(alloc.op != ir_new) continue;
+
+          // IRGen stores a new object straight into its variable; it must
+          // be the only thing ever stored there
+          int home = -1;
+          for(size_t k = i + 1; k < fn->blocks[b]->instrs.size(); k++) {
+            IRInstr &in = fn->blocks[b]->instrs[k];
+            if(in.op == ir_storelocal && in.src1 == alloc.dst) { home = in.imm; break; }
+          }
+          if(home < fn->nparams || stores_to(fn, home) != 1) continue;
+
+          std::set<int> vals;
+          vals.insert(alloc.dst);
+          loads_of(fn, home, vals);
+          Fate fa = fate(fn, vals, home);
+          if(fa == fields_only) {
+            scalar_replace(fn, alloc, home, vals);
+            scalar_replaced++;
+          }
+          else if(fa == passed) {
+            frame_allocate(fn, fn->blocks[b]->instrs[i], fn->blocks[b]->instrs, i);
+            frame_allocated++;
+          }
+        }
+      }
+    }
+  }
+};
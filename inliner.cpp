@@ -0,0 +1,213 @@
+#include "ir.hpp"
+#include "assert.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// Replaces direct calls to small, non-recursive methods with a copy of the
+// callee's body. Runs after devirtualization, since only direct calls have a
+// known target. Methods must be defined before they are used, so going
+// through the functions in program order means every callee has already had
+// its own calls inlined by the time it is copied.
+//
+// The receiver and any parameter the callee never assigns are substituted
+// directly for the virtual registers that would have loaded them, so a
+// getter shrinks to a single field load. Assigned parameters and the
+// callee's locals get fresh frame slots in the caller.
+class Inliner
+{
+  private:
+
+  IRProgram *m_program;
+  int m_budget;   // largest callee, in IR instructions, that gets inlined
+
+  std::map<std::string, IRFunction*> m_functions;
+  std::map<IRFunction*, bool> m_recursive;
+
+  // ********** Helper functions ********************************
+
+  int size(IRFunction* fn)
+  {
+    int n = 0;
+    for(size_t b = 0; b < fn->blocks.size(); b++) n += fn->blocks[b]->instrs.size();
+    return n - 1; // the return goes away
+  }
+
+  IRFunction* callee_of(const IRInstr &in)
+  {
+    if(in.op != ir_call) return NULL;
+    std::map<std::string, IRFunction*>::iterator it = m_functions.find(in.label);
+    return it == m_functions.end() ? NULL : it->second;
+  }
+
+  // Whether target can be reached from fn through direct calls
+  bool reaches(IRFunction* fn, IRFunction* target, std::map<IRFunction*, bool> &seen)
+  {
+    if(seen[fn]) return false;
+    seen[fn] = true;
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        IRFunction* c = callee_of(instrs[i]);
+        if(c != NULL && (c == target || reaches(c, target, seen))) return true;
+      }
+    }
+    return false;
+  }
+
+  bool recursive(IRFunction* fn)
+  {
+    std::map<IRFunction*, bool>::iterator it = m_recursive.find(fn);
+    if(it != m_recursive.end()) return it->second;
+    std::map<IRFunction*, bool> seen;
+    return m_recursive[fn] = reaches(fn, fn, seen);
+  }
+
+  // IRGen ends every function with its only return, so the body can be
+  // spliced in with no jump out of it
+  bool single_exit(IRFunction* fn)
+  {
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        bool last = (b + 1 == fn->blocks.size() && i + 1 == instrs.size());
+        if((instrs[i].op == ir_ret) != last) return false;
+      }
+    }
+    return true;
+  }
+
+  bool inlinable(IRFunction* caller, IRFunction* callee)
+  {
+    return callee != NULL && callee != caller && size(callee) <= m_budget
+        && !recursive(callee) && single_exit(callee);
+  }
+
+  void rename(std::vector<IRInstr> &instrs, int from, int to)
+  {
+    for(size_t i = 0; i < instrs.size(); i++) {
+      IRInstr &in = instrs[i];
+      if(in.src1 == from) in.src1 = to;
+      if(in.src2 == from) in.src2 = to;
+      for(size_t a = 0; a < in.args.size(); a++) if(in.args[a] == from) in.args[a] = to;
+    }
+  }
+
+  // Block ids are positions in the function, so renumber after inserting blocks
+  void renumber(IRFunction* fn)
+  {
+    std::map<int, int> id;
+    for(size_t b = 0; b < fn->blocks.size(); b++) id[fn->blocks[b]->id] = b;
+    for(size_t b = 0; b < fn->blocks.size(); b++) {
+      fn->blocks[b]->id = b;
+      std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+      for(size_t i = 0; i < instrs.size(); i++) {
+        if(instrs[i].target >= 0) instrs[i].target = id[instrs[i].target];
+        if(instrs[i].target2 >= 0) instrs[i].target2 = id[instrs[i].target2];
+      }
+    }
+  }
+
+  // Replace instruction i of block b in fn with the body of callee
+  void splice(IRFunction* fn, size_t b, size_t i, IRFunction* callee)
+  {
+    IRBlock* block = fn->blocks[b];
+    IRInstr call = block->instrs[i];
+    std::vector<IRInstr> post(block->instrs.begin() + i + 1, block->instrs.end());
+    block->instrs.erase(block->instrs.begin() + i, block->instrs.end());
+
+    // Callee virtual registers follow the caller's
+    std::vector<int> vmap(callee->nvregs);
+    for(int v = 0; v < callee->nvregs; v++) vmap[v] = fn->new_vreg();
+
+    // Parameters the callee assigns to need a slot of their own
+    std::vector<bool> written(callee->nparams, false);
+    for(size_t cb = 0; cb < callee->blocks.size(); cb++) {
+      std::vector<IRInstr> &instrs = callee->blocks[cb]->instrs;
+      for(size_t k = 0; k < instrs.size(); k++)
+        if(instrs[k].op == ir_storelocal && instrs[k].imm < callee->nparams) written[instrs[k].imm] = true;
+    }
+    std::vector<int> smap(callee->nparams + callee->nlocals, -1);
+    for(int s = 0; s < callee->nparams + callee->nlocals; s++)
+      if(s >= callee->nparams || written[s]) smap[s] = fn->new_local();
+    for(int s = 0; s < callee->nparams; s++) {
+      if(!written[s]) continue;
+      IRInstr st(ir_storelocal);
+      st.src1 = call.args[s+1];
+      st.imm = smap[s];
+      block->instrs.push_back(st);
+    }
+
+    // The first callee block continues the caller's block, the rest go after it
+    std::vector<IRBlock*> blocks(callee->blocks.size());
+    blocks[0] = block;
+    for(size_t cb = 1; cb < callee->blocks.size(); cb++)
+      blocks[cb] = new IRBlock(fn->blocks.size() + cb);
+
+    int result = no_vreg;
+    for(size_t cb = 0; cb < callee->blocks.size(); cb++) {
+      std::vector<IRInstr> &instrs = callee->blocks[cb]->instrs;
+      for(size_t k = 0; k < instrs.size(); k++) {
+        IRInstr in = instrs[k];
+        if(in.op == ir_self) { vmap[in.dst] = call.args[0]; continue; }
+        if(in.op == ir_loadlocal && smap[in.imm] < 0) { vmap[in.dst] = call.args[in.imm+1]; continue; }
+        if(in.op == ir_ret) { if(in.src1 != no_vreg) result = vmap[in.src1]; continue; }
+
+        if(in.dst != no_vreg) in.dst = vmap[in.dst];
+        if(in.src1 != no_vreg) in.src1 = vmap[in.src1];
+        if(in.src2 != no_vreg) in.src2 = vmap[in.src2];
+        for(size_t a = 0; a < in.args.size(); a++) in.args[a] = vmap[in.args[a]];
+        if(in.op == ir_loadlocal || in.op == ir_storelocal) in.imm = smap[in.imm];
+        if(in.target >= 0) in.target = blocks[in.target]->id;
+        if(in.target2 >= 0) in.target2 = blocks[in.target2]->id;
+        blocks[cb]->instrs.push_back(in);
+      }
+    }
+
+    // The rest of the caller's block follows the callee's last block
+    IRBlock* last = blocks.back();
+    if(result == no_vreg) {
+      IRInstr zero(ir_const); // methods returning Nothing still define their call's value
+      zero.dst = call.dst;
+      last->instrs.push_back(zero);
+    }
+    last->instrs.insert(last->instrs.end(), post.begin(), post.end());
+    fn->blocks.insert(fn->blocks.begin() + b + 1, blocks.begin() + 1, blocks.end());
+    renumber(fn);
+
+    if(result != no_vreg)
+      for(size_t k = 0; k < fn->blocks.size(); k++) rename(fn->blocks[k]->instrs, call.dst, result);
+  }
+
+  public:
+
+  int inlined;   // call sites replaced
+
+  Inliner(IRProgram *program, int budget)
+  {
+    m_program = program;
+    m_budget = budget;
+    inlined = 0;
+    for(size_t f = 0; f < program->functions.size(); f++)
+      m_functions[program->functions[f]->name] = program->functions[f];
+  }
+
+  void run()
+  {
+    for(size_t f = 0; f < m_program->functions.size(); f++) {
+      IRFunction* fn = m_program->functions[f];
+      // spliced code is scanned too; whatever the callee kept a call to was
+      // already judged not worth inlining, so this terminates
+      for(size_t b = 0; b < fn->blocks.size(); b++) {
+        for(size_t i = 0; i < fn->blocks[b]->instrs.size(); i++) {
+          IRFunction* callee = callee_of(fn->blocks[b]->instrs[i]);
+          if(!inlinable(fn, callee)) continue;
+          splice(fn, b, i, callee);
+          inlined++;
+          i--; // look again at what took the call's place
+        }
+      }
+    }
+  }
+};
@@ -0,0 +1,79 @@
+#include "intern.hpp"
+#include <string.h>
+
+Interner identifiers;
+
+/****** Interner Implementation **************************************/
+
+Interner::Interner()
+{
+	m_slots.assign(1024, 0);
+}
+
+// FNV-1a
+unsigned Interner::hash(const char* s, size_t len)
+{
+	unsigned h = 2166136261u;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// The slot holding s, or the empty slot where it would go
+size_t Interner::probe(const char* s, size_t len, unsigned h) const
+{
+	size_t mask = m_slots.size() - 1;
+	for(size_t i = h & mask; ; i = (i + 1) & mask) {
+		int e = m_slots[i];
+		if(e == 0) return i;
+		const char* t = m_spellings[e-1];
+		if(m_hashes[e-1] == h && strncmp(t, s, len) == 0 && t[len] == '\0') return i;
+	}
+}
+
+void Interner::grow()
+{
+	std::vector<int> slots(2 * m_slots.size(), 0);
+	size_t mask = slots.size() - 1;
+	for(size_t id = 0; id < m_spellings.size(); id++) {
+		size_t i = m_hashes[id] & mask;
+		while(slots[i] != 0) i = (i + 1) & mask;
+		slots[i] = id + 1;
+	}
+	m_slots.swap(slots);
+}
+
+const char* Interner::intern(const char* s, size_t len)
+{
+	unsigned h = hash(s, len);
+	size_t i = probe(s, len, h);
+	if(m_slots[i] != 0) return m_spellings[m_slots[i]-1];
+
+	// the id goes in front of the characters; the arena keeps it aligned
+	int id = m_spellings.size();
+	char* p = (char*)m_storage.alloc(sizeof(int) + len + 1);
+	*(int*)p = id;
+	p += sizeof(int);
+	memcpy(p, s, len);
+	p[len] = '\0';
+
+	m_spellings.push_back(p);
+	m_hashes.push_back(h);
+	m_slots[i] = id + 1;
+	if(2 * m_spellings.size() > m_slots.size()) grow();
+	return p;
+}
+
+const char* Interner::intern(const char* s)
+{
+	return intern(s, strlen(s));
+}
+
+int Interner::find(const char* s) const
+{
+	size_t len = strlen(s);
+	int e = m_slots[probe(s, len, hash(s, len))];
+	return e == 0 ? no_id : e - 1;
+}
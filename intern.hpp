@@ -0,0 +1,50 @@
+#ifndef INTERN_HPP
+#define INTERN_HPP
+
+#include "arena.hpp"
+#include <cstddef>
+#include <vector>
+
+// Every identifier in the program is stored once, and has a small integer
+// id: the n-th distinct spelling interned gets id n. The lexer interns each
+// name as it reads it, so the same name always has the same spelling
+// pointer, and the symbol, class and offset tables are keyed by id instead
+// of by string.
+//
+// A spelling that came from intern() carries its id in the word just before
+// its first character, so id() is a single load with no hashing.
+class Interner
+{
+  public:
+	static const int no_id = -1;
+
+	Interner();
+
+	// The one copy of the first len characters of s, added if it is new
+	const char* intern(const char* s, size_t len);
+	const char* intern(const char* s);
+
+	// The id of s, or no_id if it was never interned; s is not added
+	int find(const char* s) const;
+
+	// The id of a spelling returned by intern(); not for any other string
+	static int id(const char* spelling) { return ((const int*)spelling)[-1]; }
+
+	const char* spelling(int id) const { return m_spellings[id]; }
+	int size() const { return (int)m_spellings.size(); }
+
+  private:
+	Arena m_storage;
+	std::vector<const char*> m_spellings;   // by id
+	std::vector<unsigned> m_hashes;         // by id, so growing never rehashes strings
+	std::vector<int> m_slots;               // open addressed, id + 1 or 0 if empty
+
+	static unsigned hash(const char* s, size_t len);
+	size_t probe(const char* s, size_t len, unsigned h) const;
+	void grow();
+};
+
+// The identifiers of the program being compiled
+extern Interner identifiers;
+
+#endif //INTERN_HPP
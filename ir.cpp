@@ -0,0 +1,301 @@
+#include "ir.hpp"
+#include "intern.hpp"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****** IRInstr Implementation **************************************/
+
+void IRInstr::uses(std::vector<int> &out) const
+{
+	if(src1 != no_vreg) out.push_back(src1);
+	if(src2 != no_vreg) out.push_back(src2);
+	for(size_t i = 0; i < args.size(); i++) out.push_back(args[i]);
+}
+
+const char* ir_opname(IROpcode op)
+{
+	switch(op) {
+		case ir_const:      return "const";
+		case ir_add:        return "add";
+		case ir_sub:        return "sub";
+		case ir_mul:        return "mul";
+		case ir_div:        return "div";
+		case ir_shl:        return "shl";
+		case ir_lt:         return "lt";
+		case ir_le:         return "le";
+		case ir_not:        return "not";
+		case ir_neg:        return "neg";
+		case ir_self:       return "self";
+		case ir_loadlocal:  return "loadlocal";
+		case ir_storelocal: return "storelocal";
+		case ir_loadfield:  return "loadfield";
+		case ir_storefield: return "storefield";
+		case ir_new:        return "new";
+		case ir_framenew:   return "framenew";
+		case ir_call:       return "call";
+		case ir_vcall:      return "vcall";
+		case ir_print:      return "print";
+		case ir_jump:       return "jump";
+		case ir_branch:     return "branch";
+		case ir_blt:        return "blt";
+		case ir_ble:        return "ble";
+		case ir_ret:        return "ret";
+		default:            return "unknown";
+	}
+}
+
+/****** IRFunction Implementation **************************************/
+
+IRFunction::IRFunction(const std::string &n, int params, int c)
+{
+	name = n;
+	nparams = params;
+	cls = c;
+	nlocals = 0;
+	nvregs = 0;
+}
+
+IRFunction::~IRFunction()
+{
+	for(size_t i = 0; i < blocks.size(); i++) delete blocks[i];
+}
+
+IRBlock* IRFunction::new_block()
+{
+	IRBlock* b = new IRBlock(blocks.size());
+	blocks.push_back(b);
+	return b;
+}
+
+void IRFunction::dump(FILE* f)
+{
+	fprintf(f, "function %s params %d locals %d\n", name.c_str(), nparams, nlocals);
+	for(size_t b = 0; b < blocks.size(); b++) {
+		fprintf(f, "B%d:\n", blocks[b]->id);
+		std::vector<IRInstr> &instrs = blocks[b]->instrs;
+		for(size_t i = 0; i < instrs.size(); i++) {
+			IRInstr &in = instrs[i];
+			fprintf(f, "    ");
+			if(in.dst != no_vreg) fprintf(f, "t%d = ", in.dst);
+			fprintf(f, "%s", ir_opname(in.op));
+			switch(in.op) {
+				case ir_const: case ir_loadlocal:
+					fprintf(f, " %d", in.imm); break;
+				case ir_new: case ir_framenew:
+					fprintf(f, " %d, %s", in.imm, in.label.c_str()); break;
+				case ir_shl:
+					fprintf(f, " t%d, %d", in.src1, in.imm); break;
+				case ir_storelocal:
+					fprintf(f, " %d, t%d", in.imm, in.src1); break;
+				case ir_loadfield:
+					fprintf(f, " t%d.%d", in.src1, in.imm); break;
+				case ir_storefield:
+					fprintf(f, " t%d.%d, t%d", in.src1, in.imm, in.src2); break;
+				case ir_call: case ir_vcall:
+					if(in.op == ir_vcall) fprintf(f, " [%d]", in.imm);
+					fprintf(f, " %s", in.label.c_str());
+					for(size_t a = 0; a < in.args.size(); a++) fprintf(f, "%s t%d", a ? "," : "", in.args[a]);
+					break;
+				case ir_jump:
+					fprintf(f, " B%d", in.target); break;
+				case ir_branch:
+					fprintf(f, " t%d, B%d, B%d", in.src1, in.target, in.target2); break;
+				case ir_blt: case ir_ble:
+					fprintf(f, " t%d, t%d, B%d, B%d", in.src1, in.src2, in.target, in.target2); break;
+				default:
+					if(in.src1 != no_vreg) fprintf(f, " t%d", in.src1);
+					if(in.src2 != no_vreg) fprintf(f, ", t%d", in.src2);
+					break;
+			}
+			fprintf(f, "\n");
+		}
+	}
+	fprintf(f, "\n");
+}
+
+/****** IRClass Implementation **************************************/
+
+void IRClass::add_method(int selector, const std::string &method, const std::string &label)
+{
+	if(selector >= (int)slots.size()) slots.resize(selector + 1, -1);
+	slots[selector] = methods.size();
+	methods.push_back(method);
+	vtable.push_back(label);
+}
+
+/****** IRProgram Implementation **************************************/
+
+IRProgram::~IRProgram()
+{
+	for(size_t i = 0; i < functions.size(); i++) delete functions[i];
+	for(size_t i = 0; i < classes.size(); i++) delete classes[i];
+}
+
+long IRProgram::instructions() const
+{
+	long n = 0;
+	for(size_t f = 0; f < functions.size(); f++)
+		for(size_t b = 0; b < functions[f]->blocks.size(); b++)
+			n += functions[f]->blocks[b]->instrs.size();
+	return n;
+}
+
+void IRProgram::add_class(int id, IRClass* c)
+{
+	if(id >= (int)m_class_index.size()) m_class_index.resize(id + 1, -1);
+	m_class_index[id] = classes.size();
+	classes.push_back(c);
+}
+
+int IRProgram::selector(int method)
+{
+	if(method >= (int)m_selectors.size()) m_selectors.resize(method + 1, -1);
+	if(m_selectors[method] < 0) m_selectors[method] = m_nselectors++;
+	return m_selectors[method];
+}
+
+void IRProgram::dump(FILE* f)
+{
+	for(size_t i = 0; i < classes.size(); i++) {
+		IRClass* c = classes[i];
+		fprintf(f, "class %s", c->name.c_str());
+		if(c->super >= 0) fprintf(f, " from %s", classes[c->super]->name.c_str());
+		fprintf(f, "\n");
+		for(size_t s = 0; s < c->vtable.size(); s++) fprintf(f, "    [%d] %s\n", (int)s, c->vtable[s].c_str());
+	}
+	fprintf(f, "\n");
+	for(size_t i = 0; i < functions.size(); i++) functions[i]->dump(f);
+}
+
+// One function per header line, then one line per block and per instruction
+// with every field of it. Names are written as they are; none has spaces.
+void IRProgram::save(size_t first, size_t last, std::string &text) const
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "functions %d\n", (int)(last - first));
+	text = buf;
+	for(size_t i = first; i < last; i++) {
+		IRFunction* fn = functions[i];
+		snprintf(buf, sizeof(buf), " %d %d %d %d\n", fn->nparams, fn->nlocals, fn->nvregs, (int)fn->blocks.size());
+		text += "function " + fn->name + buf;
+		for(size_t b = 0; b < fn->blocks.size(); b++) {
+			std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+			snprintf(buf, sizeof(buf), "block %d %d\n", fn->blocks[b]->id, (int)instrs.size());
+			text += buf;
+			for(size_t k = 0; k < instrs.size(); k++) {
+				IRInstr &in = instrs[k];
+				snprintf(buf, sizeof(buf), "%d %d %d %d %d %d %d ", in.op, in.dst, in.src1, in.src2, in.imm, in.target, in.target2);
+				text += buf;
+				text += in.cls >= 0 ? classes[in.cls]->name : "-";
+				text += " " + (in.label.empty() ? std::string("-") : in.label);
+				snprintf(buf, sizeof(buf), " %d", (int)in.args.size());
+				text += buf;
+				for(size_t a = 0; a < in.args.size(); a++) {
+					snprintf(buf, sizeof(buf), " %d", in.args[a]);
+					text += buf;
+				}
+				text += "\n";
+			}
+		}
+	}
+	text += "end\n";
+}
+
+// Reads what save() wrote, a field at a time
+class IRReader
+{
+  public:
+	IRReader(const std::string &text) : m_p(text.c_str()), m_size(text.size()), m_ok(true) {}
+
+	bool ok() const { return m_ok; }
+	void fail() { m_ok = false; }
+
+	void word(const char* expected)
+	{
+		if(next() != expected) m_ok = false;
+	}
+
+	std::string next()
+	{
+		while(*m_p == ' ' || *m_p == '\n') m_p++;
+		const char* start = m_p;
+		while(*m_p != '\0' && *m_p != ' ' && *m_p != '\n') m_p++;
+		if(m_p == start) m_ok = false;
+		return std::string(start, m_p - start);
+	}
+
+	int number()
+	{
+		std::string w = next();
+		char* end;
+		long n = strtol(w.c_str(), &end, 10);
+		if(w.empty() || *end != '\0') m_ok = false;
+		return (int)n;
+	}
+
+	// a number of things that follow, each at least a byte of the text
+	int count()
+	{
+		int n = number();
+		if(n < 0 || (size_t)n > m_size) m_ok = false;
+		return m_ok ? n : 0;
+	}
+
+  private:
+	const char* m_p;
+	size_t m_size;
+	bool m_ok;
+};
+
+bool IRProgram::load(const std::string &text, int cls)
+{
+	IRReader r(text);
+	std::vector<IRFunction*> loaded;
+	r.word("functions");
+	int nfunctions = r.count();
+	for(int i = 0; i < nfunctions && r.ok(); i++) {
+		r.word("function");
+		std::string name = r.next();
+		int nparams = r.number();
+		IRFunction* fn = new IRFunction(name, nparams, cls);
+		loaded.push_back(fn);
+		fn->nlocals = r.number();
+		fn->nvregs = r.number();
+		int nblocks = r.count();
+		for(int b = 0; b < nblocks && r.ok(); b++) {
+			r.word("block");
+			IRBlock* block = fn->new_block();
+			block->id = r.number();
+			int ninstrs = r.count();
+			for(int k = 0; k < ninstrs && r.ok(); k++) {
+				int op = r.number();
+				if(op < ir_const || op > ir_ret) r.fail();
+				IRInstr in((IROpcode)op);
+				in.dst = r.number();
+				in.src1 = r.number();
+				in.src2 = r.number();
+				in.imm = r.number();
+				in.target = r.number();
+				in.target2 = r.number();
+				std::string c = r.next();
+				if(c != "-") {
+					in.cls = find_class(identifiers.find(c.c_str()));
+					if(in.cls < 0) r.fail();
+				}
+				in.label = r.next();
+				if(in.label == "-") in.label.clear();
+				in.args.resize(r.count());
+				for(size_t a = 0; a < in.args.size() && r.ok(); a++) in.args[a] = r.number();
+				block->instrs.push_back(in);
+			}
+		}
+	}
+	r.word("end");
+	if(!r.ok()) {
+		for(size_t i = 0; i < loaded.size(); i++) delete loaded[i];
+		return false;
+	}
+	functions.insert(functions.end(), loaded.begin(), loaded.end());
+	return true;
+}
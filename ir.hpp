@@ -0,0 +1,156 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Three-address intermediate representation built from the typed AST by
+// IRGen and lowered to assembly by Codegen.
+//
+// Every instruction defines at most one virtual register. Virtual registers
+// only carry expression temporaries; variables live in frame slots (params
+// and locals) or object fields and are reached through explicit loads and
+// stores. Frame slots and fields are numbered in words, so the backend
+// decides how big a word is and where each slot goes.
+//
+// Field 0 of every object holds a pointer to its class's vtable, so the
+// class's own fields start at field 1.
+
+enum IROpcode
+{
+	ir_const,       // dst = imm
+	ir_add,         // dst = src1 + src2
+	ir_sub,         // dst = src1 - src2
+	ir_mul,         // dst = src1 * src2
+	ir_div,         // dst = src1 / src2
+	ir_shl,         // dst = src1 << imm
+	ir_lt,          // dst = src1 < src2
+	ir_le,          // dst = src1 <= src2
+	ir_not,         // dst = !src1
+	ir_neg,         // dst = -src1
+	ir_self,        // dst = pointer to the current object
+	ir_loadlocal,   // dst = frame slot imm
+	ir_storelocal,  // frame slot imm = src1
+	ir_loadfield,   // dst = field imm of object src1
+	ir_storefield,  // field imm of object src1 = src2
+	ir_new,         // dst = imm words of fresh heap memory, with vtable label
+	ir_framenew,    // dst = object laid over the frame, field k in slot imm-k, with vtable label
+	ir_call,        // dst = label(args...), args[0] is the receiver
+	ir_vcall,       // dst = vtable slot imm of args[0](args...), label is the static target
+	ir_print,       // print src1
+	ir_jump,        // goto target
+	ir_branch,      // if src1 goto target else goto target2
+	ir_blt,         // if src1 < src2 goto target else goto target2
+	ir_ble,         // if src1 <= src2 goto target else goto target2
+	ir_ret          // return src1 (no value if src1 is no_vreg)
+};
+
+static const int no_vreg = -1;
+
+struct IRInstr
+{
+	IROpcode op;
+	int dst;
+	int src1;
+	int src2;
+	int imm;
+	int target;
+	int target2;
+	int cls;             // ir_vcall: static class of the receiver in IRProgram::classes
+	std::string label;
+	std::vector<int> args;
+
+	IRInstr(IROpcode o) : op(o), dst(no_vreg), src1(no_vreg), src2(no_vreg), imm(0), target(-1), target2(-1), cls(-1) {}
+
+	bool is_call() const { return op == ir_call || op == ir_vcall; }
+
+	bool is_terminator() const { return op == ir_jump || op == ir_branch || op == ir_blt || op == ir_ble || op == ir_ret; }
+
+	// virtual registers read by this instruction
+	void uses(std::vector<int> &out) const;
+};
+
+struct IRBlock
+{
+	int id;
+	std::vector<IRInstr> instrs;
+
+	IRBlock(int i) : id(i) {}
+};
+
+class IRFunction
+{
+  public:
+	std::string name;    // assembly label, Class_method
+	int nparams;         // frame slots 0..nparams-1 are the arguments
+	int nlocals;         // slots nparams..nparams+nlocals-1 are locals
+	int nvregs;
+	int cls;             // the class defining it, in IRProgram::classes
+	std::vector<IRBlock*> blocks;
+
+	IRFunction(const std::string &n, int params, int c);
+	~IRFunction();
+
+	int new_vreg() { return nvregs++; }
+	IRBlock* new_block();
+	int new_local() { return nparams + nlocals++; }
+
+	void dump(FILE* f);
+};
+
+// Methods get vtable slots in the order they are first defined; a subclass
+// starts from a copy of its superclass's table and overrides in place.
+// Slots are looked up by selector, the program-wide number IRProgram gives
+// each method name, so finding one is an index rather than a name search.
+class IRClass
+{
+  public:
+	std::string name;
+	int super;                          // index in IRProgram::classes, -1 if none
+	std::vector<std::string> methods;   // method name per vtable slot
+	std::vector<std::string> vtable;    // implementing function label per slot
+	std::vector<int> slots;             // vtable slot per selector, -1 if none
+
+	IRClass(const std::string &n, int s) : name(n), super(s) {}
+
+	int slot(int selector) const { return selector >= 0 && selector < (int)slots.size() ? slots[selector] : -1; }
+	void add_method(int selector, const std::string &method, const std::string &label);
+	std::string vtable_label() const { return name + "_vtable"; }
+};
+
+class IRProgram
+{
+  public:
+	std::vector<IRFunction*> functions;   // each class's methods together, in class order
+	std::vector<IRClass*> classes;   // superclasses always come before subclasses
+	int programSize;     // words in the Program object handed to start
+
+	IRProgram() : programSize(0), m_nselectors(0) {}
+	~IRProgram();
+
+	// classes and method names are known by their ids in identifiers
+	void add_class(int id, IRClass* c);
+	int find_class(int id) const { return id >= 0 && id < (int)m_class_index.size() ? m_class_index[id] : -1; }
+	int selector(int method);         // numbering the method name if it is new
+	int find_selector(int method) const { return method >= 0 && method < (int)m_selectors.size() ? m_selectors[method] : -1; }
+	long instructions() const;
+	void dump(FILE* f);
+
+	// functions[first..last) as text that load() reads back. Classes are
+	// written by name, so the text does not depend on where they are in
+	// classes.
+	void save(size_t first, size_t last, std::string &text) const;
+	// Append the functions in text, defined by classes[cls]; false if the
+	// text is damaged, in which case nothing is added
+	bool load(const std::string &text, int cls);
+
+  private:
+	std::vector<int> m_class_index;   // index in classes by class name id, -1 if none
+	std::vector<int> m_selectors;     // selector by method name id, -1 if none
+	int m_nselectors;
+};
+
+const char* ir_opname(IROpcode op);
+
+#endif //IR_HPP
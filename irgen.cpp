@@ -0,0 +1,609 @@
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "classhierarchy.hpp"
+#include "astcast.hpp"
+#include "primitive.hpp"
+#include "ir.hpp"
+#include "compilecache.hpp"
+#include "assert.h"
+#include <typeinfo>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+
+// Walks the typed AST and builds the three-address IR for every method.
+// Object and frame layouts are worked out here as well: each class gets an
+// OffsetTable of field slots and each method one of parameter and local
+// slots, all counted in words. Each class also gets an IRClass describing
+// its vtable, and every call is emitted as a virtual one through it.
+//
+// A class whose IR was found in the cache is still laid out, fields and
+// vtable, but its methods are read back instead of generated.
+class IRGen : public Visitor
+{
+  private:
+
+  IRProgram *m_program;
+  SymTab *m_symboltable;
+  ClassTable *m_classtable;
+  const CachedClasses *m_cached;  // NULL if there is no cache
+  bool m_shifts;                  // multiply by powers of two with shifts; set with constant folding
+  size_t m_class;                 // index of the class being visited
+
+  const char * currClassName;
+  IRClass *currClass;
+
+  OffsetTable*currClassOffset;
+  OffsetTable*currMethodOffset;
+
+  // What each identifier names as a variable right now, by identifier id.
+  // The current class's fields are bound when the class is entered and as
+  // they are declared, and a method's parameters and locals on top of them
+  // until the method ends, so each variable reference is a single index
+  // rather than a search of the offset tables.
+  struct VarRef
+  {
+    enum { unbound, local, field } kind;
+    int offset;
+    CompoundType type;
+  };
+  std::vector<VarRef> m_vars;
+  std::vector<int> m_fields;                           // ids bound as fields
+  std::vector<std::pair<int, VarRef> > m_shadowed;     // what the method's names hid
+
+  bool inMethod;
+
+  IRFunction *currFunction;
+  IRBlock *currBlock;
+
+  int m_value; // virtual register holding the result of the last expression visited
+
+  // Branch targets for blocks that have not been created yet are handed out
+  // as negative placeholders and patched once the block exists, so blocks
+  // are still created in layout order. Placeholder -2-k has its entry k
+  // here: the instructions that jump to it, as block and index.
+  std::vector<std::vector<std::pair<IRBlock*, size_t> > > m_pending;
+
+  // ********** Helper functions ********************************
+
+  void emit(const IRInstr &in)
+  {
+    std::pair<IRBlock*, size_t> at(currBlock, currBlock->instrs.size());
+    currBlock->instrs.push_back(in);
+    if(in.target < -1) m_pending[-2 - in.target].push_back(at);
+    if(in.target2 < -1 && in.target2 != in.target) m_pending[-2 - in.target2].push_back(at);
+  }
+
+  // Emit an instruction that defines a fresh virtual register and return it
+  int emit_value(IROpcode op, int src1 = no_vreg, int src2 = no_vreg, int imm = 0)
+  {
+    IRInstr in(op);
+    in.dst = currFunction->new_vreg();
+    in.src1 = src1;
+    in.src2 = src2;
+    in.imm = imm;
+    emit(in);
+    return in.dst;
+  }
+
+  int eval(Expression *e) { e->accept(this); return m_value; }
+
+  void binary(IROpcode op, Expression *e1, Expression *e2)
+  {
+    int a = eval(e1);
+    int b = eval(e2);
+    m_value = emit_value(op, a, b);
+  }
+
+  int new_pending()
+  {
+    m_pending.resize(m_pending.size() + 1);
+    return -1 - (int)m_pending.size();
+  }
+
+  // Label each virtual call with the method its static class's finished
+  // vtable holds in the called slot
+  void name_call_targets()
+  {
+    for(size_t f = 0; f < m_program->functions.size(); f++) {
+      IRFunction* fn = m_program->functions[f];
+      for(size_t b = 0; b < fn->blocks.size(); b++) {
+        std::vector<IRInstr> &instrs = fn->blocks[b]->instrs;
+        for(size_t i = 0; i < instrs.size(); i++)
+          if(instrs[i].op == ir_vcall) instrs[i].label = m_program->classes[instrs[i].cls]->vtable[instrs[i].imm];
+      }
+    }
+  }
+
+  void resolve(int pending, int id)
+  {
+    std::vector<std::pair<IRBlock*, size_t> > &refs = m_pending[-2 - pending];
+    for(size_t k = 0; k < refs.size(); k++) {
+      IRInstr &in = refs[k].first->instrs[refs[k].second];
+      if(in.target == pending) in.target = id;
+      if(in.target2 == pending) in.target2 = id;
+    }
+    refs.clear();
+  }
+
+  void jump(int target)
+  {
+    IRInstr in(ir_jump);
+    in.target = target;
+    emit(in);
+  }
+
+  // Jumping code for a condition: control goes to block t when e holds and
+  // to block f when it does not, without materializing a boolean. The right
+  // operand of an and is only evaluated when the left one holds.
+  void branch(Expression *e, int t, int f)
+  {
+    ExprKind kind = expr_kind(e);
+    if(kind == ek_and) {
+      And *a = ast_cast<And>(e);
+      int right = new_pending();
+      branch(a->m_expression_1, right, f);
+      currBlock = currFunction->new_block();
+      resolve(right, currBlock->id);
+      branch(a->m_expression_2, t, f);
+      return;
+    }
+
+    if(kind == ek_not) { branch(ast_cast<Not>(e)->m_expression, f, t); return; }
+
+    if(kind == ek_booleanliteral) { jump(ast_cast<BooleanLiteral>(e)->m_primitive->m_data ? t : f); return; }
+
+    IRInstr in(ir_branch);
+    LessThan *lt = kind == ek_lessthan ? ast_cast<LessThan>(e) : NULL;
+    LessThanEqualTo *le = kind == ek_lessthanequalto ? ast_cast<LessThanEqualTo>(e) : NULL;
+    if(lt != NULL || le != NULL) {
+      in.op = lt != NULL ? ir_blt : ir_ble;
+      in.src1 = eval(lt != NULL ? lt->m_expression_1 : le->m_expression_1);
+      in.src2 = eval(lt != NULL ? lt->m_expression_2 : le->m_expression_2);
+    } else {
+      in.src1 = eval(e);
+    }
+    in.target = t;
+    in.target2 = f;
+    emit(in);
+  }
+
+  // log2 of an integer literal that is a power of two above 1, else 0
+  int power_of_two(Expression *e)
+  {
+    IntegerLiteral *lit = expr_cast<IntegerLiteral>(e);
+    if(lit == NULL) return 0;
+    unsigned int v = lit->m_primitive->m_data;
+    if(v < 2 || (v & (v - 1)) != 0) return 0;
+    int k = 0;
+    while(v > 1) { v >>= 1; k++; }
+    return k;
+  }
+
+  VarRef &var(int id)
+  {
+    if(id >= (int)m_vars.size()) {
+      VarRef none = { VarRef::unbound, 0, { bt_undef, NULL } };
+      m_vars.resize(std::max(id + 1, identifiers.size()), none);
+    }
+    return m_vars[id];
+  }
+
+  void bind_field(const OffsetTable::Slot &s)
+  {
+    VarRef &v = var(s.id);
+    if(v.kind == VarRef::unbound) m_fields.push_back(s.id);
+    v.kind = VarRef::field;
+    v.offset = s.offset;
+    v.type = s.type;
+  }
+
+  void bind_local(int id, int slot, CompoundType type)
+  {
+    VarRef &v = var(id);
+    m_shadowed.push_back(std::make_pair(id, v));
+    v.kind = VarRef::local;
+    v.offset = slot;
+    v.type = type;
+  }
+
+  // Variables are either in the method frame or fields of the current
+  // object; name is the variable's identifier id
+  int load_variable(int name)
+  {
+    VarRef &v = var(name);
+    if(v.kind == VarRef::local)
+      return emit_value(ir_loadlocal, no_vreg, no_vreg, v.offset);
+    assert(v.kind == VarRef::field);
+    int self = emit_value(ir_self);
+    return emit_value(ir_loadfield, self, no_vreg, v.offset);
+  }
+
+  void store_variable(int name, int value)
+  {
+    VarRef &v = var(name);
+    if(v.kind == VarRef::local) {
+      IRInstr in(ir_storelocal);
+      in.src1 = value;
+      in.imm = v.offset;
+      emit(in);
+      return;
+    }
+    assert(v.kind == VarRef::field);
+    IRInstr in(ir_storefield);
+    in.src1 = emit_value(ir_self);
+    in.src2 = value;
+    in.imm = v.offset;
+    emit(in);
+  }
+
+  CompoundType variable_type(int name)
+  {
+    assert(var(name).kind != VarRef::unbound);
+    return var(name).type;
+  }
+
+  // Arguments are evaluated last to first, as the stack-based calling
+  // convention always has, and the receiver last of all. The receiver is
+  // args[0]: the named variable, or the current object if receiver is no_id.
+  // The vtable slot comes from the receiver's static class; the devirtualizer
+  // turns the call into a direct one when no subclass overrides that slot.
+  // The label, naming the static target, is filled in by name_call_targets
+  // once every vtable is finished, since a method later in the class can
+  // still override the slot. The class and method are given by identifier id.
+  void call(int classname, int funcname, int receiver, list<Expression_ptr> *l)
+  {
+    int cls = m_program->find_class(classname);
+    assert(cls >= 0);
+    IRClass* c = m_program->classes[cls];
+    int slot = c->slot(m_program->find_selector(funcname));
+    assert(slot >= 0);
+
+    IRInstr in(ir_vcall);
+    in.cls = cls;
+    in.imm = slot;
+    Items<Expression_ptr>& a = items_of(l);
+    std::vector<int> vals(a.size());
+    for(size_t k = a.size(); k-- > 0;) vals[k] = eval(a[k]);
+    in.args.push_back(receiver != Interner::no_id ? load_variable(receiver) : emit_value(ir_self));
+    in.args.insert(in.args.end(), vals.begin(), vals.end());
+    in.dst = currFunction->new_vreg();
+    emit(in);
+    m_value = in.dst;
+  }
+
+  // Give a method of the current class its vtable slot, overriding the
+  // inherited one or taking a new one; returns the method's label, made
+  // from the class name and method name
+  std::string take_slot(SymName* method)
+  {
+    std::string label = std::string(currClassName) + "_" + method->spelling();
+    int selector = m_program->selector(method->id());
+    int vslot = currClass->slot(selector);
+    if(vslot < 0) currClass->add_method(selector, method->spelling(), label);
+    else currClass->vtable[vslot] = label;
+    return label;
+  }
+
+public:
+
+  IRGen(IRProgram * program, SymTab * st, ClassTable* ct, const CachedClasses* cached, bool shifts)
+  {
+    m_program = program;
+    m_symboltable = st;
+    m_classtable = ct;
+    m_cached = cached;
+    m_shifts = shifts;
+    m_class = 0;
+    currMethodOffset=currClassOffset=NULL;
+    currClass = NULL;
+    currFunction = NULL;
+    currBlock = NULL;
+    inMethod = false;
+    m_value = no_vreg;
+  }
+  //=====================================================================================================================
+  void visitProgramImpl(ProgramImpl *p) {
+
+    // Visit the children
+    Items<Class_ptr>& l = items_of(p->m_class_list);
+    for(m_class = 0; m_class < l.size(); m_class++) l[m_class]->accept(this);
+    name_call_targets();
+
+    m_program->programSize = m_classtable->lookup("Program")->offset->getTotalSize();
+  }
+  //=====================================================================================================================
+  void visitClassImpl(ClassImpl *p) {
+
+      // Set current class name for function labels
+      ClassName* classname = classname_of(p->m_classid_1);
+      currClassName = classname->spelling();
+
+      // Create this class's classnode and insert into class table
+      ClassNode* node = new ClassNode();
+      node->name = new ClassName(*classname);
+      node->superClass = NULL;
+      node->scope = new SymScope();
+      node->p = p;
+      currClass = new IRClass(currClassName, -1);
+      if(p->m_classid_2!=NULL) {
+          ClassName* superclass = classname_of(p->m_classid_2);
+          assert(m_classtable->exist(superclass));
+          node->superClass = new ClassName(*superclass);
+          node->offset->extend(m_classtable->lookup(superclass)->offset);
+
+          // Start from the superclass's vtable
+          currClass->super = m_program->find_class(superclass->id());
+          assert(currClass->super >= 0);
+          IRClass* super = m_program->classes[currClass->super];
+          currClass->methods = super->methods;
+          currClass->vtable = super->vtable;
+          currClass->slots = super->slots;
+      } else {
+          node->offset->setTotalSize(1); // field 0 is the vtable pointer
+      }
+      currClassOffset = node->offset;
+      m_classtable->insert(node->name, node);
+
+      // Only this class's fields, inherited ones included, are visible
+      for(size_t i = 0; i < m_fields.size(); i++) m_vars[m_fields[i]].kind = VarRef::unbound;
+      m_fields.clear();
+      currClassOffset->for_each_slot([this](const OffsetTable::Slot& s) { bind_field(s); });
+      m_program->add_class(classname->id(), currClass);
+
+      inMethod = false;
+
+      // Visit the children
+      visit_items(p->m_declaration_list, this);
+      if(m_cached != NULL && m_cached->hit(m_class)) {
+          Items<Method_ptr>& l = items_of(p->m_method_list);
+          for(size_t i = 0; i < l.size(); i++) take_slot(symname_of(ast_cast<MethodImpl>(l[i])->m_methodid));
+          if(!m_program->load(m_cached->ir[m_class], m_program->classes.size() - 1)) {
+              fprintf(stderr, "cache entry %s for class %s is damaged; remove it and compile again\n", m_cached->keys[m_class].c_str(), currClassName);
+              exit(1);
+          }
+          return;
+      }
+      visit_items(p->m_method_list, this);
+  }
+  //=====================================================================================================================
+  void visitDeclarationImpl(DeclarationImpl *p) {
+
+      Basetype type = p->m_type->m_attribute.m_type.baseType;
+      assert(type == bt_boolean || type == bt_integer || type == bt_object);
+
+      // Iterate through list of variables, giving each a slot in the object or frame
+      Items<VariableID_ptr>& l = items_of(p->m_variableid_list);
+      VariableIDImpl* var;
+      for(size_t i = 0; i < l.size(); i++) {
+            var = ast_cast<VariableIDImpl>(l[i]);
+            if(!inMethod) {
+                int slot = currClassOffset->getTotalSize();
+                currClassOffset->insert(var->m_symname->id(), slot, 1, p->m_type->m_attribute.m_type.classType);
+                currClassOffset->setTotalSize(slot+1);
+                bind_field(currClassOffset->last_slot());
+                continue;
+            }
+
+            int slot = currFunction->new_local();
+            currMethodOffset->insert(var->m_symname->id(), slot, 1, p->m_type->m_attribute.m_type.classType);
+            bind_local(var->m_symname->id(), slot, p->m_type->m_attribute.m_type.classType);
+
+            // Object locals get their storage from the heap right away
+            if(type == bt_object) {
+                const char* c = p->m_type->m_attribute.m_type.classType.classID;
+                assert(m_classtable->exist(c));
+                ClassNode* node = m_classtable->lookup(c);
+                IRInstr alloc(ir_new);
+                alloc.dst = currFunction->new_vreg();
+                alloc.imm = node->offset->getTotalSize();
+                alloc.label = m_program->classes[m_program->find_class(Interner::id(c))]->vtable_label();
+                emit(alloc);
+                IRInstr in(ir_storelocal);
+                in.src1 = alloc.dst;
+                in.imm = slot;
+                emit(in);
+            }
+      }
+  }
+  //=====================================================================================================================
+  void visitMethodImpl(MethodImpl *p) {
+
+      inMethod = true;
+
+      Items<Parameter_ptr>& l = items_of(p->m_parameter_list);
+      currFunction = new IRFunction(take_slot(symname_of(p->m_methodid)), l.size(), m_program->classes.size() - 1);
+      m_program->functions.push_back(currFunction);
+      currBlock = currFunction->new_block();
+      m_pending.clear();
+
+      // Set offset tables
+      assert(m_classtable->exist(currClassName));
+      ClassNode* node = m_classtable->lookup(currClassName);
+      currClassOffset = node->offset;
+      currMethodOffset = new OffsetTable();
+
+      // Parameters take the first frame slots, in order
+      ParameterImpl* param;
+      int slot = 0;
+      for(size_t i = 0; i < l.size(); i++) {
+            param = ast_cast<ParameterImpl>(l[i]);
+            int id = symname_of(param->m_variableid)->id();
+            currMethodOffset->insert(id, slot, 1, param->m_type->m_attribute.m_type.classType);
+            bind_local(id, slot++, param->m_type->m_attribute.m_type.classType);
+      }
+
+      // Visit the body; the name, parameters and type are done
+      p->m_methodbody->accept(this);
+
+      // Uncover the fields the method's names hid
+      while(!m_shadowed.empty()) {
+          m_vars[m_shadowed.back().first] = m_shadowed.back().second;
+          m_shadowed.pop_back();
+      }
+      delete currMethodOffset;
+      currMethodOffset = NULL;
+      currFunction = NULL;
+      currBlock = NULL;
+
+      inMethod = false;
+  }
+  //=====================================================================================================================
+  void visitMethodBodyImpl(MethodBodyImpl *p) {
+
+      // Visit the children
+      visit_items(p->m_declaration_list, this);
+      visit_items(p->m_statement_list, this);
+      p->m_return->accept(this);
+
+  }
+  //=====================================================================================================================
+  void visitParameterImpl(ParameterImpl *p) {
+
+      // Visit the children
+      p->visit_children(this);
+
+  }
+  //=====================================================================================================================
+  void visitAssignment(Assignment *p) {
+
+      int v = eval(p->m_expression);
+      store_variable(symname_of(p->m_variableid)->id(), v);
+
+  }
+  //=====================================================================================================================
+  void visitIf(If *p) {
+
+      // Branch into the statement's block or past it
+      int body = new_pending(), join = new_pending();
+      branch(p->m_expression, body, join);
+
+      currBlock = currFunction->new_block();
+      resolve(body, currBlock->id);
+      p->m_statement->accept(this);
+
+      // The join block is created after the statement so blocks stay in layout order
+      IRBlock* next = currFunction->new_block();
+      resolve(join, next->id);
+      jump(next->id);
+      currBlock = next;
+
+  }
+  //=====================================================================================================================
+  void visitPrint(Print *p) {
+
+      IRInstr in(ir_print);
+      in.src1 = eval(p->m_expression);
+      emit(in);
+
+  }
+  //=====================================================================================================================
+  void visitReturnImpl(ReturnImpl *p) {
+
+      IRInstr in(ir_ret);
+      if(p->m_attribute.m_type.baseType != bt_nothing) in.src1 = eval(p->m_expression);
+      emit(in);
+
+  }
+  //=====================================================================================================================
+  void visitTInteger(TInteger *p) {}
+  //=====================================================================================================================
+  void visitTBoolean(TBoolean *p) {}
+  //=====================================================================================================================
+  void visitTNothing(TNothing *p) {}
+  //=====================================================================================================================
+  void visitTObject(TObject *p) {}
+  //=====================================================================================================================
+  void visitClassIDImpl(ClassIDImpl *p) {}
+  //=====================================================================================================================
+  void visitVariableIDImpl(VariableIDImpl *p) {}
+  //=====================================================================================================================
+  void visitMethodIDImpl(MethodIDImpl *p) {}
+  //=====================================================================================================================
+  void visitPlus(Plus *p) { binary(ir_add, p->m_expression_1, p->m_expression_2); }
+  //=====================================================================================================================
+  void visitMinus(Minus *p) { binary(ir_sub, p->m_expression_1, p->m_expression_2); }
+  //=====================================================================================================================
+  void visitTimes(Times *p)
+  {
+    // multiplying by a power of two is a shift, when constant folding is on
+    int k = m_shifts ? power_of_two(p->m_expression_2) : 0;
+    if(k > 0) { m_value = emit_value(ir_shl, eval(p->m_expression_1), no_vreg, k); return; }
+    k = m_shifts ? power_of_two(p->m_expression_1) : 0;
+    if(k > 0) { m_value = emit_value(ir_shl, eval(p->m_expression_2), no_vreg, k); return; }
+    binary(ir_mul, p->m_expression_1, p->m_expression_2);
+  }
+  //=====================================================================================================================
+  void visitDivide(Divide *p) { binary(ir_div, p->m_expression_1, p->m_expression_2); }
+  //=====================================================================================================================
+  void visitAnd(And *p)
+  {
+    // Lowered as a predicate, so the right side only runs when the left one
+    // holds; each way out stores the result in a frame slot of its own
+    int slot = currFunction->new_local();
+    int t = new_pending(), f = new_pending(), join = new_pending();
+    branch(p, t, f);
+    for(int value = 1; value >= 0; value--) {
+      currBlock = currFunction->new_block();
+      resolve(value ? t : f, currBlock->id);
+      IRInstr in(ir_storelocal);
+      in.imm = slot;
+      in.src1 = emit_value(ir_const, no_vreg, no_vreg, value);
+      emit(in);
+      jump(join);
+    }
+    currBlock = currFunction->new_block();
+    resolve(join, currBlock->id);
+    m_value = emit_value(ir_loadlocal, no_vreg, no_vreg, slot);
+  }
+  //=====================================================================================================================
+  void visitLessThan(LessThan *p) { binary(ir_lt, p->m_expression_1, p->m_expression_2); }
+  //=====================================================================================================================
+  void visitLessThanEqualTo(LessThanEqualTo *p) { binary(ir_le, p->m_expression_1, p->m_expression_2); }
+  //=====================================================================================================================
+  void visitNot(Not *p) { m_value = emit_value(ir_not, eval(p->m_expression)); }
+  //=====================================================================================================================
+  void visitUnaryMinus(UnaryMinus *p) { m_value = emit_value(ir_neg, eval(p->m_expression)); }
+  //=====================================================================================================================
+  void visitMethodCall(MethodCall *p) {
+
+      // Grab variable's classname (for call label) from offset table
+      int var = symname_of(p->m_variableid)->id();
+      call(Interner::id(variable_type(var).classID), symname_of(p->m_methodid)->id(), var, p->m_expression_list);
+
+  }
+  //=====================================================================================================================
+  void visitSelfCall(SelfCall *p) {
+
+      call(Interner::id(currClassName), symname_of(p->m_methodid)->id(), Interner::no_id, p->m_expression_list);
+
+  }
+  //=====================================================================================================================
+  void visitVariable(Variable *p) {
+      m_value = load_variable(symname_of(p->m_variableid)->id());
+  }
+  //=====================================================================================================================
+  void visitIntegerLiteral(IntegerLiteral *p) {
+      // Visit the children
+      p->visit_children(this);
+  }
+  //=====================================================================================================================
+  void visitBooleanLiteral(BooleanLiteral *p) {
+      // Visit the children
+      p->visit_children(this);
+  }
+  //=====================================================================================================================
+  void visitNothing(Nothing *p) { m_value = no_vreg; }
+  //=====================================================================================================================
+  void visitSymName(SymName *p) {}
+  //=====================================================================================================================
+  void visitPrimitive(Primitive *p) {
+      m_value = emit_value(ir_const, no_vreg, no_vreg, p->m_data);
+  }
+  //=====================================================================================================================
+  void visitClassName(ClassName *p) {}
+  //=====================================================================================================================
+  void visitNullPointer() {}
+  //=====================================================================================================================
+};
@@ -1,47 +1,337 @@
 /*
-	This file is provided for you to run your parser.  You should not have
-	to edit anything if you did the yacc and lex files correctly.  All this
-	file does is calls yyparse() and uses the visitor class ast2dot to print
-	the graph
+	The compiler driver. It reads the command line, calls yyparse() on the
+	input file (or stdin) and then runs the passes the options select,
+	writing assembly, IR or the ast2dot graph to the output file (or stdout).
 */
 #include "ast.hpp"
 #include "parser.hpp"
 #include "typecheck.cpp" 
+#include "constfold.cpp"
+#include "irgen.cpp"
+#include "devirt.cpp"
+#include "inliner.cpp"
+#include "escape.cpp"
 #include "codegen.cpp"
+#include "codegen64.cpp"
+#include "stats.hpp"
+#include "arena.hpp"
+#include "source.hpp"
+#include "compilecache.hpp"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
 
 extern int yydebug; // set this to 1 if you want yyparse to dump a trace
 extern int yyparse(); // this actually the parser which then calls the scanner
+extern int yylex(); // the scanner, called on its own by --lex-only
+extern void scan_source(char* text, size_t size); // scan the text in place
+extern int syntax_errors; // reported by yyerror, which lets parsing carry on
+extern int error_limit; // stop after this many syntax errors; 0 for no limit
 
 Program_ptr ast; // make sure to set to the final syntax tree in parser.ypp
-void dopass_ast2dot(Program_ptr ast); // this is defined in ast2dot.cpp
+void dopass_ast2dot(Program_ptr ast, FILE* out); // this is defined in ast2dot.cpp
+long count_nodes(Program_ptr ast); // this is defined in nodecount.cpp
 
-void dopass_typecheck(Program_ptr ast, SymTab* st, ClassTable* ct) {
-        Typecheck* typecheck = new Typecheck(stderr, st, ct); //create the visitor
+CompileStats stats; // timings and counts for --time-report
+
+// returns the number of errors found, which are printed at the end
+int dopass_typecheck(Program_ptr ast, SymTab* st, ClassTable* ct, int error_limit, CachedClasses* cached) {
+        Typecheck* typecheck = new Typecheck(stderr, st, ct, error_limit, cached); //create the visitor
         ast->accept(typecheck); //walk the tree with the visitor above
+        int errors = typecheck->report();
+	delete typecheck;
+        return errors;
+}
+
+void dopass_constfold(Program_ptr ast, CachedClasses* cached) {
+        ConstFold* constfold = new ConstFold(cached); //create the visitor
+        ast->accept(constfold); //fold constants in place
+	delete constfold;
+}
+
+void dopass_irgen(Program_ptr ast, SymTab* st, ClassTable* ct, IRProgram* program, CachedClasses* cached, bool shifts) {
+        IRGen* irgen = new IRGen(program, st, ct, cached, shifts); //create the visitor
+        ast->accept(irgen); //walk the tree with the visitor above
+	delete irgen;
+}
+
+// Keep the IR of each class that was not found, before the passes that
+// work across classes change it
+void store_classes(IRProgram* program, CachedClasses* cached) {
+        size_t first = 0;
+        std::string text;
+        for(size_t k = 0; k < program->classes.size(); k++) {
+                size_t last = first;
+                while(last < program->functions.size() && program->functions[last]->cls == (int)k) last++;
+                if(!cached->hit(k)) {
+                        program->save(first, last, text);
+                        cached->cache->store(cached->keys[k], text);
+                }
+                first = last;
+        }
+}
+
+void dopass_devirt(IRProgram* program) {
+        Devirtualize* devirt = new Devirtualize(program);
+        devirt->run(); //make calls direct where no subclass overrides the callee
+        stats.count("calls devirtualized", devirt->devirtualized);
+	delete devirt;
+}
+
+void dopass_inline(IRProgram* program, int budget) {
+        Inliner* inliner = new Inliner(program, budget);
+        inliner->run(); //copy small methods into their call sites
+        stats.count("calls inlined", inliner->inlined);
+	delete inliner;
+}
+
+void dopass_escape(IRProgram* program) {
+        EscapeAnalysis* escape = new EscapeAnalysis(program);
+        escape->run(); //keep objects that never leave their method off the heap
+        stats.count("scalar replaced", escape->scalar_replaced);
+        stats.count("frame allocated", escape->frame_allocated);
+	delete escape;
+}
+
+void count_cache(CompileCache* cache) {
+        if(cache == NULL) return;
+        stats.count("classes from cache", cache->hits);
+        stats.count("classes lowered", cache->misses);
 }
 
-void dopass_codegen(Program_ptr ast, SymTab* st, ClassTable* ct) {
-        Codegen* codegen = new Codegen(stderr, st, ct); //create the visitor
-        ast->accept(codegen); //walk the tree with the visitor above
+void dopass_codegen64(IRProgram* program, FILE* out, bool markers, CompileCache* cache, int jobs) {
+        Codegen64* codegen = new Codegen64(out, markers, cache, jobs);
+        codegen->generate(program); //lower every IR function to x86-64 assembly
+        stats.count("instructions emitted", codegen->emitted);
+        count_cache(cache);
 	delete codegen;
 }
 
-int main(void) {
+void dopass_codegen(IRProgram* program, FILE* out, bool peephole, bool peephole_stats, bool markers, CompileCache* cache, int jobs) {
+        Codegen* codegen = new Codegen(out, peephole, markers, cache, jobs);
+        codegen->generate(program); //lower every IR function to assembly
+        stats.count("instructions emitted", codegen->emitted);
+        count_cache(cache);
+        if(peephole_stats) codegen->peephole_report();
+	delete codegen;
+}
+
+// "-" or no -o at all means stdout
+static FILE* open_output(const char* outfile) {
+        if(outfile == NULL || strcmp(outfile, "-") == 0) return stdout;
+        FILE* out = fopen(outfile, "w");
+        if(out == NULL) perror(outfile);
+        return out;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [options] [file.lang]\n", name);
+    fprintf(stderr, "  -o FILE               write the output to FILE instead of stdout\n");
+    fprintf(stderr, "  --emit=asm|ir|dot     assembly (default), the optimized IR, or the syntax tree as a DOT graph\n");
+    fprintf(stderr, "  -O0 | -O1 | -O2       no optimization; folding, devirtualization and peephole; everything (default)\n");
+    fprintf(stderr, "  -m32 | -m64           32-bit x86 (default) or x86-64 output\n");
+    fprintf(stderr, "  --inline-budget=N     largest method, in IR instructions, to inline; 0 turns inlining off\n");
+    fprintf(stderr, "  --no-constfold --no-devirt --no-escape --no-peephole   turn off a single pass\n");
+    fprintf(stderr, "  --peephole-stats      append per-rule peephole counts as comments\n");
+    fprintf(stderr, "  --no-markers          leave the #### comments out of the assembly\n");
+    fprintf(stderr, "  --time-report[=json]  time, peak memory and counts for each pass, on stderr\n");
+    fprintf(stderr, "  --lex-only            only scan the input, to time the scanner; writes nothing\n");
+    fprintf(stderr, "  -jN | --jobs=N        lower methods to assembly on N threads (default 1); 0 for one per core\n");
+    fprintf(stderr, "  --cache-dir=DIR       reuse the IR and assembly of classes that are unchanged since an earlier compile\n");
+    fprintf(stderr, "  --cache-size=MB       keep the cache directory under MB megabytes (default 256)\n");
+    fprintf(stderr, "  --max-errors=N        stop after N syntax or type errors (default 20); 0 for no limit\n");
+}
+
+int main(int argc, char **argv) {
     SymTab st; //symbol table 
     ClassTable ct;
+    enum { emit_asm, emit_ir, emit_dot } emit = emit_asm;
+    const char* infile = NULL;   // stdin if not given
+    const char* outfile = NULL;  // stdout if not given
+    bool constfold = true;
+    bool devirt = true;
+    int inline_budget = 10; // largest method body, in IR instructions, to inline; 0 turns it off
+    bool escape = true;
+    bool peephole = true;
+    bool peephole_stats = false; // append per-rule counts to the assembly as comments
+    bool target64 = false; // x86-64 System V output instead of 32-bit x86
+    bool markers = true; // #### comments in the assembly naming each IR instruction
+    bool lex_only = false; // scan the input and stop
+    int jobs = 1; // threads for codegen; the output is the same for any number
+    const char* cache_dir = NULL; // where compiled classes are kept between compiles; none if not given
+    long cache_size = 256; // in MB; the least recently used classes go past it
+    enum { report_none, report_table, report_json } report = report_none;
+
+    // options apply in order, so -O0 --inline-budget=5 inlines and nothing else
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) outfile = argv[++i];
+        else if(strcmp(argv[i], "--emit=asm") == 0) emit = emit_asm;
+        else if(strcmp(argv[i], "--emit=ir") == 0) emit = emit_ir;
+        else if(strcmp(argv[i], "--emit=dot") == 0) emit = emit_dot;
+        else if(strcmp(argv[i], "-O0") == 0) {
+            constfold = devirt = escape = peephole = false;
+            inline_budget = 0;
+        }
+        else if(strcmp(argv[i], "-O1") == 0) {
+            constfold = devirt = peephole = true;
+            escape = false;
+            inline_budget = 0;
+        }
+        else if(strcmp(argv[i], "-O2") == 0) {
+            constfold = devirt = escape = peephole = true;
+            inline_budget = 10;
+        }
+        else if(strncmp(argv[i], "--inline-budget=", 16) == 0) inline_budget = atoi(argv[i] + 16);
+        else if(strcmp(argv[i], "--no-constfold") == 0) constfold = false;
+        else if(strcmp(argv[i], "--no-devirt") == 0) devirt = false;
+        else if(strcmp(argv[i], "--no-escape") == 0) escape = false;
+        else if(strcmp(argv[i], "--no-peephole") == 0) peephole = false;
+        else if(strcmp(argv[i], "--peephole-stats") == 0) peephole_stats = true;
+        else if(strcmp(argv[i], "--no-markers") == 0) markers = false;
+        else if(strcmp(argv[i], "--time-report") == 0) report = report_table;
+        else if(strcmp(argv[i], "--time-report=json") == 0) report = report_json;
+        else if(strcmp(argv[i], "--lex-only") == 0) lex_only = true;
+        else if(strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+        else if(strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') jobs = atoi(argv[i] + 2);
+        else if(strncmp(argv[i], "--cache-dir=", 12) == 0) cache_dir = argv[i] + 12;
+        else if(strncmp(argv[i], "--cache-size=", 13) == 0) cache_size = atol(argv[i] + 13);
+        else if(strncmp(argv[i], "--max-errors=", 13) == 0) error_limit = atoi(argv[i] + 13);
+        else if(strcmp(argv[i], "-m64") == 0) target64 = true;
+        else if(strcmp(argv[i], "-m32") == 0) target64 = false;
+        else if(argv[i][0] != '-' && infile == NULL) infile = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(jobs <= 0) jobs = std::thread::hardware_concurrency();
+    if(jobs <= 0) jobs = 1; // the core count is not known
+
+    // the scanner works straight on the mapped file
+    SourceFile source;
+    if(!source.open(infile)) {
+        perror(infile != NULL ? infile : "stdin");
+        return 1;
+    }
+    scan_source(source.text(), source.size());
+    // the output is opened only once there is something to write to it,
+    // so a failed compile leaves an earlier output file as it was
+    FILE* out = NULL;
+
+    if(lex_only) {
+        // the scanner on its own; bench/lex.sh turns this into MB/s
+        stats.begin("lex");
+        long tokens = 0;
+        while(yylex() != 0) tokens++;
+        stats.end();
+        stats.count("tokens", tokens);
+        stats.count("input bytes", source.size());
+        stats.count("identifiers", identifiers.size());
+        if(report == report_table) stats.report_table(stderr);
+        else if(report == report_json) stats.report_json(stderr);
+        return 0;
+    }
+
     // set this to 1 if you would like to print a trace 
     // of the entire parsing process (it prints to stdout)
     yydebug = 0; 
     
     // after parsing, the global "ast" should be set to the
     // syntax tree that we have built up during the parse
-    yyparse();  
+    stats.begin("parse");
+    int failed = yyparse();  
+    stats.end();
+    // every syntax error has been reported; the tree has holes, so stop here
+    if(failed != 0 || syntax_errors > 0) return 1;
+    // the cache knows a class by its text, so that is taken before it goes
+    CompileCache* cache = cache_dir != NULL && emit != emit_dot ? new CompileCache(cache_dir, cache_size * 1024 * 1024) : NULL;
+    CachedClasses* cached = NULL;
+    if(cache != NULL) {
+        cached = new CachedClasses(cache, constfold ? "constfold" : "");
+        for(size_t k = 0; k < class_spans.size(); k++)
+            cached->sources.push_back(CompileCache::digest(source.text() + class_spans[k].begin, class_spans[k].end - class_spans[k].begin));
+    }
+    // names are interned and numbers converted, so the text is not needed
+    source.close();
+    // counting walks the tree, so only pay for it when the counts are wanted
+    // it is reported once here, not again for every pass that walks the same tree
+    if(report != report_none) stats.count("ast nodes", count_nodes(ast));
+    stats.count("arena KB", compile_arena.allocated() / 1024);
     
-    // walk over the ast and print it out as a dot file
-    dopass_ast2dot( ast );
-    dopass_typecheck(ast, &st, &ct); 
-    dopass_codegen(ast, &st, &ct); 
+    if(emit == emit_dot) {
+        // walk over the ast and print it out as a dot file
+        if((out = open_output(outfile)) == NULL) return 1;
+        stats.begin("ast2dot");
+        dopass_ast2dot(ast, out);
+        stats.end();
+    }
+    else {
+        stats.begin("typecheck");
+        int errors = dopass_typecheck(ast, &st, &ct, error_limit, cached); 
+        stats.end();
+        if(errors > 0) return 1;
+        if(constfold) {
+            stats.begin("constfold");
+            dopass_constfold(ast, cached);
+            stats.end();
+            // folding shrinks the tree, so this is the only other total worth reporting
+            if(report != report_none) stats.count("ast nodes", count_nodes(ast));
+        }
+
+        // lower the typed tree to IR, then the IR to assembly
+        IRProgram program;
+        stats.begin("irgen");
+        dopass_irgen(ast, &st, &ct, &program, cached, constfold);
+        if(cached != NULL) store_classes(&program, cached);
+        stats.end();
+        stats.count("ir instructions", program.instructions());
+        if(cache != NULL) {
+            stats.count("classes reused", cache->ir_hits);
+            stats.count("classes generated", cache->ir_misses);
+        }
+        if(devirt) {
+            stats.begin("devirt");
+            dopass_devirt(&program);
+            stats.end();
+        }
+        if(inline_budget > 0) {
+            stats.begin("inline");
+            dopass_inline(&program, inline_budget);
+            stats.end();
+            stats.count("ir instructions", program.instructions());
+        }
+        if(escape) {
+            stats.begin("escape");
+            dopass_escape(&program);
+            stats.end();
+        }
+        if((out = open_output(outfile)) == NULL) return 1;
+        if(emit == emit_ir) {
+            stats.begin("irdump");
+            program.dump(out);
+            stats.end();
+        }
+        else {
+            // cached classes skip the peephole pass, so their rules would go uncounted
+            CompileCache* asm_cache = peephole_stats ? NULL : cache;
+            stats.begin("codegen");
+            if(target64) dopass_codegen64(&program, out, markers, asm_cache, jobs); // the peephole rules only know the 32-bit conventions
+            else dopass_codegen(&program, out, peephole, peephole_stats, markers, asm_cache, jobs); 
+            stats.end();
+            stats.count("jobs", jobs);
+        }
+    }
+    fclose(out);
+    if(cache != NULL) cache->sweep();
+    delete cached;
+    delete cache;
+
+    // the tree and its strings go all at once
+    compile_arena.release();
+
+    if(report == report_table) stats.report_table(stderr);
+    else if(report == report_json) stats.report_json(stderr);
     return 0;
 }
-
@@ -1,2 +1,8 @@
-echo "Making ./start from test.s"
-gcc -g -m32 -o start start.c test.s
+# ./make_start.sh [-m64] links test.s, made with the same flag, into ./start
+if [ "$1" = "-m64" ]; then
+    echo "Making ./start from test.s (x86-64)"
+    gcc -g -o start runtime.c test.s
+else
+    echo "Making ./start from test.s"
+    gcc -g -m32 -o start runtime.c test.s
+fi
@@ -0,0 +1,63 @@
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "primitive.hpp"
+#include "classhierarchy.hpp"
+#include "stdio.h"
+
+// Counts the nodes of the syntax tree, for --time-report. Every tree pass
+// walks the whole tree, so this is also how many nodes each of them visits.
+class NodeCount : public Visitor {
+ public:
+ long nodes;
+
+ NodeCount() { nodes = 0; }
+
+ void count(Visitable* p) { nodes++; p->visit_children(this); }
+
+ void visitProgramImpl(ProgramImpl *p) { count(p); }
+ void visitClassImpl(ClassImpl *p) { count(p); }
+ void visitDeclarationImpl(DeclarationImpl *p) { count(p); }
+ void visitMethodImpl(MethodImpl *p) { count(p); }
+ void visitMethodBodyImpl(MethodBodyImpl *p) { count(p); }
+ void visitParameterImpl(ParameterImpl *p) { count(p); }
+ void visitAssignment(Assignment *p) { count(p); }
+ void visitIf(If *p) { count(p); }
+ void visitPrint(Print *p) { count(p); }
+ void visitReturnImpl(ReturnImpl *p) { count(p); }
+ void visitTInteger(TInteger *p) { count(p); }
+ void visitTBoolean(TBoolean *p) { count(p); }
+ void visitTNothing(TNothing *p) { count(p); }
+ void visitTObject(TObject *p) { count(p); }
+ void visitClassIDImpl(ClassIDImpl *p) { count(p); }
+ void visitVariableIDImpl(VariableIDImpl *p) { count(p); }
+ void visitMethodIDImpl(MethodIDImpl *p) { count(p); }
+ void visitPlus(Plus *p) { count(p); }
+ void visitMinus(Minus *p) { count(p); }
+ void visitTimes(Times *p) { count(p); }
+ void visitDivide(Divide *p) { count(p); }
+ void visitAnd(And *p) { count(p); }
+ void visitLessThan(LessThan *p) { count(p); }
+ void visitLessThanEqualTo(LessThanEqualTo *p) { count(p); }
+ void visitNot(Not *p) { count(p); }
+ void visitUnaryMinus(UnaryMinus *p) { count(p); }
+ void visitMethodCall(MethodCall *p) { count(p); }
+ void visitSelfCall(SelfCall *p) { count(p); }
+ void visitVariable(Variable *p) { count(p); }
+ void visitIntegerLiteral(IntegerLiteral *p) { count(p); }
+ void visitBooleanLiteral(BooleanLiteral *p) { count(p); }
+ void visitNothing(Nothing *p) { count(p); }
+
+ //special cases
+ void visitSymName(SymName *p) { nodes++; }
+ void visitPrimitive(Primitive *p) { nodes++; }
+ void visitClassName(ClassName *p) { nodes++; }
+
+ //very special case
+ void visitNullPointer() { nodes++; }
+};
+
+long count_nodes(Program_ptr ast) {
+        NodeCount counter;
+        ast->accept(&counter); //walk the tree once, counting as we go
+        return counter.nodes;
+}
@@ -0,0 +1,33 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs work(worker, item) for every item in 0..n-1 on up to jobs threads.
+// Items are handed out in order as threads come free, so a long item does
+// not hold up the others behind it. worker (0..jobs-1) says which thread a
+// call is on, for state each thread keeps to itself; worker 0 is the
+// calling thread. With one job nothing is started.
+template <class Work>
+void parallel_for(size_t n, int jobs, Work work)
+{
+	if((size_t)jobs > n) jobs = n;
+	if(jobs <= 1) {
+		for(size_t i = 0; i < n; i++) work(0, i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	auto run = [&](int worker) {
+		for(size_t i = next++; i < n; i = next++) work(worker, i);
+	};
+	std::vector<std::thread> threads;
+	for(int t = 1; t < jobs; t++) threads.push_back(std::thread(run, t));
+	run(0);
+	for(size_t t = 0; t < threads.size(); t++) threads[t].join();
+}
+
+#endif //PARALLEL_HPP
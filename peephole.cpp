@@ -0,0 +1,360 @@
+#include "peephole.hpp"
+#include <assert.h>
+#include <string.h>
+#include <ctype.h>
+
+/****** Operand helpers **************************************/
+
+static std::string trim(const std::string &s)
+{
+	size_t b = s.find_first_not_of(" \t");
+	if(b == std::string::npos) return "";
+	size_t e = s.find_last_not_of(" \t");
+	return s.substr(b, e - b + 1);
+}
+
+static bool is_reg(const std::string &o) { return !o.empty() && o[0] == '%'; }
+static bool is_imm(const std::string &o) { return !o.empty() && o[0] == '$'; }
+static bool is_mem(const std::string &o) { return !o.empty() && !is_reg(o) && !is_imm(o); }
+
+// The 32-bit register a byte register is part of
+static std::string full(const std::string &reg)
+{
+	if(reg == "%al") return "%eax";
+	if(reg == "%bl") return "%ebx";
+	if(reg == "%cl") return "%ecx";
+	if(reg == "%dl") return "%edx";
+	return reg;
+}
+
+// Whether reg appears anywhere in an operand, including as an address base
+static bool mentions(const std::string &operand, const std::string &reg)
+{
+	for(size_t p = operand.find('%'); p != std::string::npos; p = operand.find('%', p + 1)) {
+		size_t e = p + 1;
+		while(e < operand.size() && isalpha(operand[e])) e++;
+		if(full(operand.substr(p, e - p)) == reg) return true;
+	}
+	return false;
+}
+
+/****** AsmLine Implementation **************************************/
+
+AsmLine::AsmLine(const std::string &line)
+{
+	text = line;
+	std::string t = trim(line);
+	if(t.empty() || t[0] == '#' || t[0] == '.') { kind = other; return; }
+	if(t[t.size()-1] == ':') { kind = label; return; }
+
+	kind = instr;
+	size_t sp = t.find_first_of(" \t");
+	op = t.substr(0, sp);
+	if(sp == std::string::npos) return;
+
+	// operands are split on commas outside of parentheses
+	std::string rest = t.substr(sp);
+	int depth = 0;
+	size_t start = 0;
+	for(size_t p = 0; p <= rest.size(); p++) {
+		if(p == rest.size() || (rest[p] == ',' && depth == 0)) {
+			operands.push_back(trim(rest.substr(start, p - start)));
+			start = p + 1;
+		} else if(rest[p] == '(') depth++;
+		else if(rest[p] == ')') depth--;
+	}
+}
+
+std::string AsmLine::str() const
+{
+	if(kind != instr) return text;
+	std::string s = "  " + op;
+	for(size_t i = 0; i < operands.size(); i++) s += (i ? ", " : " ") + operands[i];
+	return s;
+}
+
+/****** Peephole Implementation **************************************/
+
+Peephole::Peephole()
+{
+	Rule rules[] = {
+		{"push/pop same operand",     &Peephole::push_pop_same,     0, 0},
+		{"push/pop to move",          &Peephole::push_pop_move,     0, 0},
+		{"move to itself",            &Peephole::self_move,         0, 0},
+		{"add/sub zero",              &Peephole::add_zero,          0, 0},
+		{"load after store",          &Peephole::store_load,        0, 0},
+		{"move back",                 &Peephole::move_back,         0, 0},
+		{"repeated load",             &Peephole::repeated_load,     0, 0},
+		{"dead register move",        &Peephole::dead_move,         0, 0},
+		{"copy forwarding",           &Peephole::copy_forward,      0, 0},
+		{"immediate operand",         &Peephole::immediate_operand, 0, 0},
+		{"jump to next line",         &Peephole::jump_to_next,      0, 0},
+	};
+	m_rules.assign(rules, rules + sizeof(rules)/sizeof(rules[0]));
+}
+
+void Peephole::run(const std::string &text, FILE* out)
+{
+	m_lines.clear();
+	size_t start = 0;
+	while(start < text.size()) {
+		size_t e = text.find('\n', start);
+		if(e == std::string::npos) e = text.size();
+		m_lines.push_back(AsmLine(text.substr(start, e - start)));
+		start = e + 1;
+	}
+
+	// Keep sweeping the rule table over every instruction until nothing changes
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(size_t i = 0; i < m_lines.size(); i++) {
+			for(size_t r = 0; r < m_rules.size() && m_lines[i].kind == AsmLine::instr; r++) {
+				int n = (this->*m_rules[r].apply)(i);
+				if(n < 0) continue;
+				m_rules[r].applied++;
+				m_rules[r].removed += n;
+				changed = true;
+			}
+		}
+	}
+
+	for(size_t i = 0; i < m_lines.size(); i++) {
+		if(m_lines[i].kind == AsmLine::deleted) continue;
+		std::string line = m_lines[i].str();
+		line += '\n';
+		fwrite(line.data(), 1, line.size(), out);
+	}
+}
+
+void Peephole::report(FILE* out)
+{
+	fprintf(out, "# peephole %-24s %8s %8s\n", "rule", "applied", "removed");
+	int total = 0;
+	for(size_t r = 0; r < m_rules.size(); r++) {
+		fprintf(out, "# peephole %-24s %8d %8d\n", m_rules[r].name, m_rules[r].applied, m_rules[r].removed);
+		total += m_rules[r].removed;
+	}
+	fprintf(out, "# peephole %-24s %8s %8d\n", "total", "", total);
+}
+
+void Peephole::merge(const Peephole &other)
+{
+	for(size_t r = 0; r < m_rules.size(); r++) {
+		m_rules[r].applied += other.m_rules[r].applied;
+		m_rules[r].removed += other.m_rules[r].removed;
+	}
+}
+
+// The next instruction or label after line i, skipping comments
+size_t Peephole::next(size_t i)
+{
+	for(i++; i < m_lines.size(); i++)
+		if(m_lines[i].kind == AsmLine::instr || m_lines[i].kind == AsmLine::label) break;
+	return i;
+}
+
+bool Peephole::is_op(size_t i, const char* op)
+{
+	return i < m_lines.size() && m_lines[i].kind == AsmLine::instr && m_lines[i].op == op;
+}
+
+bool Peephole::reads(const AsmLine &in, const std::string &reg)
+{
+	if(in.op == "ret") return reg == "%ebx";  // the return value
+	if(in.op == "cdq") return reg == "%eax";
+	if(in.op == "idivl" && (reg == "%eax" || reg == "%edx")) return true;
+	if(in.operands.empty()) return false;
+
+	for(size_t k = 0; k + 1 < in.operands.size(); k++)
+		if(mentions(in.operands[k], reg)) return true;
+
+	// the last operand is read unless it is a register the instruction only writes
+	const std::string &d = in.dst();
+	if(!is_reg(d)) return mentions(d, reg);
+	if(full(d) != reg) return false;
+	return !(in.op == "movl" || in.op == "movzbl" || in.op == "leal" || in.op == "popl");
+}
+
+bool Peephole::writes(const AsmLine &in, const std::string &reg)
+{
+	if(in.op == "call") return true;  // calls trash every register
+	if(in.op == "cdq") return reg == "%edx";
+	if(in.op == "idivl") return reg == "%eax" || reg == "%edx";
+	if(in.operands.empty() || in.op[0] == 'j') return false;
+	if(in.op == "cmpl" || in.op == "testl" || in.op == "pushl") return false;
+	return is_reg(in.dst()) && full(in.dst()) == reg;
+}
+
+// Whether the value in reg is never read again after line i. Anything
+// reaching a label or a jump counts as live, since the other side is not
+// looked at.
+bool Peephole::dead_after(size_t i, const std::string &reg)
+{
+	if(reg == "%esp" || reg == "%ebp") return false;
+	for(size_t j = next(i); j < m_lines.size(); j = next(j)) {
+		const AsmLine &in = m_lines[j];
+		if(in.kind == AsmLine::label || in.op[0] == 'j') return false;
+		if(reads(in, reg)) return false;
+		if(in.op == "ret" || writes(in, reg)) return true;
+	}
+	return false;
+}
+
+/****** Rules **************************************/
+
+// pushl X / popl X
+int Peephole::push_pop_same(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "pushl") || !is_op(j, "popl") || m_lines[i].dst() != m_lines[j].dst()) return -1;
+	remove(i);
+	remove(j);
+	return 2;
+}
+
+// pushl X / popl Y  =>  movl X, Y
+int Peephole::push_pop_move(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "pushl") || !is_op(j, "popl")) return -1;
+	std::string x = m_lines[i].dst(), y = m_lines[j].dst();
+	if(is_mem(x) && is_mem(y)) return -1;
+	if(mentions(x, "%esp") || mentions(y, "%esp")) return -1;
+	m_lines[i].op = "movl";
+	m_lines[i].operands.push_back(y);
+	remove(j);
+	return 1;
+}
+
+// movl X, X
+int Peephole::self_move(size_t i)
+{
+	AsmLine &in = m_lines[i];
+	if(in.op != "movl" || in.operands[0] != in.operands[1]) return -1;
+	remove(i);
+	return 1;
+}
+
+// addl $0, X and subl $0, X; Codegen never branches on the flags they set
+int Peephole::add_zero(size_t i)
+{
+	AsmLine &in = m_lines[i];
+	if((in.op != "addl" && in.op != "subl") || in.operands[0] != "$0") return -1;
+	remove(i);
+	return 1;
+}
+
+// movl R, M / movl M, X  =>  movl R, M / movl R, X
+int Peephole::store_load(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "movl") || !is_op(j, "movl")) return -1;
+	std::string r = m_lines[i].operands[0], m = m_lines[i].operands[1];
+	if(!is_reg(r) || !is_mem(m) || m_lines[j].operands[0] != m) return -1;
+	if(m_lines[j].operands[1] == r) {
+		remove(j);
+		return 1;
+	}
+	m_lines[j].operands[0] = r;
+	return 0;
+}
+
+// movl A, B / movl B, A
+int Peephole::move_back(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "movl") || !is_op(j, "movl")) return -1;
+	std::string a = m_lines[i].operands[0], b = m_lines[i].operands[1];
+	if(m_lines[j].operands[0] != b || m_lines[j].operands[1] != a) return -1;
+	if(is_mem(a) && mentions(a, full(b))) return -1; // the address changed
+	remove(j);
+	return 1;
+}
+
+// movl M, R ... movl M, X with nothing in between touching R, the registers
+// M is addressed through, or memory: the second load is dropped if X is R,
+// and reads R instead of memory otherwise
+int Peephole::repeated_load(size_t i)
+{
+	AsmLine &in = m_lines[i];
+	if(in.op != "movl" || !is_mem(in.operands[0]) || !is_reg(in.dst())) return -1;
+	std::string m = in.operands[0], r = in.dst();
+	if(mentions(m, r) || mentions(m, "%esp")) return -1;
+
+	const char* regs[] = {"%eax", "%ebx", "%ecx", "%edx", "%esi", "%edi"};
+	for(size_t j = next(i); j < m_lines.size(); j = next(j)) {
+		AsmLine &later = m_lines[j];
+		if(later.kind != AsmLine::instr || later.op[0] == 'j') return -1;
+		if(later.op == "call" || later.op == "ret" || later.op == "leave") return -1;
+		if(later.op == "movl" && later.operands[0] == m) {
+			if(later.dst() != r) {
+				later.operands[0] = r;
+				return 0;
+			}
+			remove(j);
+			return 1;
+		}
+		if(writes(later, r)) return -1;
+		for(size_t k = 0; k < sizeof(regs)/sizeof(regs[0]); k++)
+			if(mentions(m, regs[k]) && writes(later, regs[k])) return -1;
+		bool stores = !later.operands.empty() && is_mem(later.dst())
+			&& later.op != "cmpl" && later.op != "testl" && later.op != "pushl" && later.op != "idivl";
+		if(stores) return -1;
+	}
+	return -1;
+}
+
+// A register written and never read again
+int Peephole::dead_move(size_t i)
+{
+	AsmLine &in = m_lines[i];
+	if(in.op != "movl" && in.op != "movzbl" && in.op != "leal") return -1;
+	if(!is_reg(in.dst()) || !dead_after(i, full(in.dst()))) return -1;
+	remove(i);
+	return 1;
+}
+
+// movl X, R / movl R, Y  =>  movl X, Y when R is dead afterwards
+int Peephole::copy_forward(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "movl") || !is_op(j, "movl")) return -1;
+	std::string x = m_lines[i].operands[0], r = m_lines[i].dst(), y = m_lines[j].dst();
+	if(!is_reg(r) || m_lines[j].operands[0] != r || y == r) return -1;
+	if(is_mem(x) && is_mem(y)) return -1;
+	if(mentions(y, r) || !dead_after(j, r)) return -1;
+	m_lines[j].operands[0] = x;
+	remove(i);
+	return 1;
+}
+
+// movl $c, R / op R, D  =>  op $c, D when R is dead afterwards
+int Peephole::immediate_operand(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "movl") || !is_imm(m_lines[i].operands[0]) || !is_reg(m_lines[i].dst())) return -1;
+	if(j >= m_lines.size() || m_lines[j].kind != AsmLine::instr) return -1;
+	AsmLine &use = m_lines[j];
+	std::string r = m_lines[i].dst();
+	const char* ops[] = {"addl", "subl", "cmpl", "imull"};
+	bool ok = false;
+	for(size_t k = 0; k < sizeof(ops)/sizeof(ops[0]); k++) if(use.op == ops[k]) ok = true;
+	if(!ok || use.operands.size() != 2 || use.operands[0] != r) return -1;
+	if(mentions(use.dst(), r) || is_imm(use.dst())) return -1;
+	if(use.op == "imull" && !is_reg(use.dst())) return -1; // no memory destination with an immediate
+	if(!dead_after(j, r)) return -1;
+	use.operands[0] = m_lines[i].operands[0];
+	remove(i);
+	return 1;
+}
+
+// jmp L immediately followed by L:
+int Peephole::jump_to_next(size_t i)
+{
+	size_t j = next(i);
+	if(!is_op(i, "jmp") || j >= m_lines.size() || m_lines[j].kind != AsmLine::label) return -1;
+	if(trim(m_lines[j].text) != m_lines[i].dst() + ":") return -1;
+	remove(i);
+	return 1;
+}
@@ -0,0 +1,80 @@
+#ifndef PEEPHOLE_HPP
+#define PEEPHOLE_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Peephole optimizer over the AT&T assembly text Codegen emits for a method.
+// The text is split into lines, instructions are parsed into a mnemonic and
+// operands, and a table of rewrite rules is applied until none of them fires.
+// Comments, labels and directives pass through untouched; rules look past
+// comments but never across a label.
+//
+// The rules rely on the conventions Codegen follows: %ebp and %esp only
+// hold the frame, a call trashes every register, and %ebx is the only
+// register that carries a value out of a method.
+
+struct AsmLine
+{
+	enum Kind { instr, label, other, deleted };
+
+	Kind kind;
+	std::string text;                   // the line as written, for anything but instructions
+	std::string op;
+	std::vector<std::string> operands;  // AT&T order, destination last
+
+	AsmLine(const std::string &line);
+
+	std::string str() const;
+	const std::string& dst() const { return operands.back(); }
+};
+
+class Peephole
+{
+  public:
+	struct Rule
+	{
+		const char* name;
+		int (Peephole::*apply)(size_t i);   // instructions removed, or -1 if the rule does not match
+		int applied;
+		int removed;
+	};
+
+	Peephole();
+
+	// Optimize one method's worth of assembly and write it to out
+	void run(const std::string &text, FILE* out);
+
+	// Per-rule counts, as assembly comments
+	void report(FILE* out);
+
+	// Add the counts of another optimizer running the same rules
+	void merge(const Peephole &other);
+
+  private:
+	std::vector<AsmLine> m_lines;
+	std::vector<Rule> m_rules;
+
+	size_t next(size_t i);
+	bool is_op(size_t i, const char* op);
+	void remove(size_t i) { m_lines[i].kind = AsmLine::deleted; }
+
+	bool reads(const AsmLine &in, const std::string &reg);
+	bool writes(const AsmLine &in, const std::string &reg);
+	bool dead_after(size_t i, const std::string &reg);
+
+	int push_pop_same(size_t i);
+	int push_pop_move(size_t i);
+	int self_move(size_t i);
+	int add_zero(size_t i);
+	int store_load(size_t i);
+	int move_back(size_t i);
+	int repeated_load(size_t i);
+	int dead_move(size_t i);
+	int copy_forward(size_t i);
+	int immediate_operand(size_t i);
+	int jump_to_next(size_t i);
+};
+
+#endif //PEEPHOLE_HPP
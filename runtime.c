@@ -0,0 +1,88 @@
+/*
+ * Runtime library linked with every compiled program.
+ *
+ * Objects come from a region allocator: memory is claimed from the system in
+ * regions that double in size as the program grows, and objects are carved
+ * off the current region by bumping a pointer. Nothing is freed before the
+ * program exits: objects the compiler can prove die with their method never
+ * reach the heap (see escape.cpp), and the rest go with their regions at exit.
+ * Total heap size is capped at HEAP_LIMIT bytes; running past it, or
+ * the system refusing a region, stops the program with a message instead of
+ * writing over memory that is not ours.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef HEAP_LIMIT
+#define HEAP_LIMIT (1024L*1024*1024)
+#endif
+
+#define REGION_MIN  (64*1024)
+#define GRAIN       8                    /* allocations are rounded up to this */
+
+typedef struct Region {
+	struct Region *next;
+	size_t size;
+} Region;
+
+static Region *regions;          /* most recent first */
+static char *top, *end;          /* unused part of the current region */
+static size_t reserved;          /* bytes claimed from the system so far */
+
+void Start(void);
+
+static void out_of_memory(size_t bytes)
+{
+	fprintf(stderr, "out of memory: %lu bytes requested with %lu in use\n",
+	        (unsigned long)bytes, (unsigned long)reserved);
+	exit(1);
+}
+
+/* Make room for at least bytes more in a fresh region */
+static void grow(size_t bytes)
+{
+	size_t size = regions ? 2*regions->size : REGION_MIN;
+	size_t need = bytes + sizeof(Region);
+	Region *r;
+
+	if (size < need)
+		size = need;
+	if (reserved + size > HEAP_LIMIT) {
+		size = need > REGION_MIN ? need : REGION_MIN;
+		if (reserved + size > HEAP_LIMIT)
+			out_of_memory(bytes);
+	}
+	r = (Region*)calloc(1, size);
+	if (r == NULL)
+		out_of_memory(bytes);
+	r->next = regions;
+	r->size = size;
+	regions = r;
+	reserved += size;
+	top = (char*)(r + 1);
+	end = (char*)r + size;
+}
+
+/* Zeroed memory for an object of the given size */
+void* Alloc(int bytes)
+{
+	size_t size = ((size_t)bytes + GRAIN - 1) & ~(size_t)(GRAIN - 1);
+	void *p;
+
+	if ((size_t)(end - top) < size)
+		grow(size);
+	p = top;
+	top += size;
+	return p;
+}
+
+int main(int argc, char **argv)
+{
+	Start();
+	while (regions != NULL) {
+		Region *next = regions->next;
+		free(regions);
+		regions = next;
+	}
+	return 0;
+}
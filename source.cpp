@@ -0,0 +1,112 @@
+#include "source.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/****** SourceFile Implementation **************************************/
+
+SourceFile::SourceFile()
+{
+	m_text = NULL;
+	m_size = 0;
+	m_length = 0;
+	m_mapped = false;
+}
+
+SourceFile::~SourceFile()
+{
+	close();
+}
+
+bool SourceFile::open(const char* path)
+{
+	close();
+	int fd = path != NULL ? ::open(path, O_RDONLY) : 0;
+	if(fd < 0) return false;
+
+	struct stat st;
+	bool ok;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) ok = map(fd, st.st_size) || read(fd);
+	else ok = read(fd);
+
+	int saved = errno;
+	if(fd != 0) ::close(fd);
+	errno = saved;
+	return ok;
+}
+
+// The file is mapped over the front of a zeroed anonymous mapping two bytes
+// longer than it, so the zeros after the text are there even when the file
+// ends on a page boundary, where touching past a file mapping would fault.
+// Both are private: the scanner writes a zero after each token while it
+// looks at it, which must not reach the file.
+bool SourceFile::map(int fd, size_t size)
+{
+	size_t length = size + 2;
+	void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED) return false;
+	if(mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(base, length);
+		return false;
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+
+	m_text = (char*)base;
+	m_size = size;
+	m_length = length;
+	m_mapped = true;
+	return true;
+}
+
+bool SourceFile::read(int fd)
+{
+	size_t cap = 64 * 1024;
+	char* buf = (char*)malloc(cap);
+	if(buf == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+	size_t len = 0;
+	for(;;) {
+		if(cap - len <= 2) {
+			char* bigger = (char*)realloc(buf, 2 * cap);
+			if(bigger == NULL) {
+				free(buf);
+				errno = ENOMEM;
+				return false;
+			}
+			buf = bigger;
+			cap *= 2;
+		}
+		ssize_t n = ::read(fd, buf + len, cap - len - 2);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0) {
+			free(buf);
+			return false;
+		}
+		if(n == 0) break;
+		len += n;
+	}
+	buf[len] = buf[len+1] = '\0';
+
+	m_text = buf;
+	m_size = len;
+	m_length = cap;
+	m_mapped = false;
+	return true;
+}
+
+void SourceFile::close()
+{
+	if(m_text == NULL) return;
+	if(m_mapped) munmap(m_text, m_length);
+	else free(m_text);
+	m_text = NULL;
+	m_size = 0;
+	m_length = 0;
+	m_mapped = false;
+}
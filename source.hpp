@@ -0,0 +1,41 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstddef>
+
+// The program text, mapped straight from the file instead of being read
+// through stdio into the scanner's own buffer. The scanner runs over the
+// mapped bytes in place and interns each name from them, so nothing of the
+// text is copied except the one spelling of each distinct identifier.
+//
+// The text is followed by two zero bytes, which is how the scanner finds
+// its end. A file that cannot be mapped (a pipe, or stdin) is read into
+// memory instead, with the same layout.
+class SourceFile
+{
+  public:
+	SourceFile();
+	~SourceFile();
+
+	// Map path, or read it if it cannot be mapped; false with errno set if
+	// it cannot be opened or read. A NULL path reads stdin.
+	bool open(const char* path);
+
+	// Unmap the text; spellings already interned stay valid
+	void close();
+
+	char* text() { return m_text; }
+	size_t size() const { return m_size; }
+	bool mapped() const { return m_mapped; }
+
+  private:
+	char* m_text;
+	size_t m_size;
+	size_t m_length;   // of the mapping, including the terminating zeros
+	bool m_mapped;
+
+	bool map(int fd, size_t size);
+	bool read(int fd);
+};
+
+#endif //SOURCE_HPP
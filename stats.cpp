@@ -0,0 +1,90 @@
+#include "stats.hpp"
+#include <time.h>
+#include <sys/resource.h>
+
+long stat_symtab_lookups = 0;
+long stat_classtable_lookups = 0;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+	struct rusage ru;
+	if(getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+	return ru.ru_maxrss; // kilobytes on Linux
+}
+
+/****** CompileStats Implementation **************************************/
+
+CompileStats::CompileStats()
+{
+	m_start = 0;
+	m_symtab_start = m_classtable_start = 0;
+}
+
+void CompileStats::begin(const char* pass)
+{
+	Pass p;
+	p.name = pass;
+	p.seconds = 0;
+	p.peak_rss_kb = 0;
+	m_passes.push_back(p);
+	m_symtab_start = stat_symtab_lookups;
+	m_classtable_start = stat_classtable_lookups;
+	m_start = now();
+}
+
+void CompileStats::end()
+{
+	Pass &p = m_passes.back();
+	p.seconds = now() - m_start;
+	p.peak_rss_kb = peak_rss_kb();
+	if(stat_symtab_lookups != m_symtab_start)
+		count("symtab lookups", stat_symtab_lookups - m_symtab_start);
+	if(stat_classtable_lookups != m_classtable_start)
+		count("classtable lookups", stat_classtable_lookups - m_classtable_start);
+}
+
+void CompileStats::count(const char* what, long n)
+{
+	if(m_passes.empty()) return;
+	m_passes.back().counts.push_back(std::make_pair(std::string(what), n));
+}
+
+void CompileStats::report_table(FILE* out)
+{
+	double total = 0;
+	for(size_t i = 0; i < m_passes.size(); i++) total += m_passes[i].seconds;
+
+	fprintf(out, "%-12s %10s %6s %10s  %s\n", "pass", "ms", "%", "peak KB", "counts");
+	for(size_t i = 0; i < m_passes.size(); i++) {
+		Pass &p = m_passes[i];
+		fprintf(out, "%-12s %10.3f %6.1f %10ld", p.name.c_str(), p.seconds * 1e3,
+		        total > 0 ? 100 * p.seconds / total : 0.0, p.peak_rss_kb);
+		for(size_t c = 0; c < p.counts.size(); c++)
+			fprintf(out, "%s%s=%ld", c ? ", " : " ", p.counts[c].first.c_str(), p.counts[c].second);
+		fprintf(out, "\n");
+	}
+	fprintf(out, "%-12s %10.3f %6.1f %10ld\n", "total", total * 1e3, 100.0, peak_rss_kb());
+}
+
+void CompileStats::report_json(FILE* out)
+{
+	fprintf(out, "{\"passes\": [");
+	double total = 0;
+	for(size_t i = 0; i < m_passes.size(); i++) {
+		Pass &p = m_passes[i];
+		total += p.seconds;
+		fprintf(out, "%s\n  {\"name\": \"%s\", \"seconds\": %.6f, \"peak_rss_kb\": %ld, \"counts\": {",
+		        i ? "," : "", p.name.c_str(), p.seconds, p.peak_rss_kb);
+		for(size_t c = 0; c < p.counts.size(); c++)
+			fprintf(out, "%s\"%s\": %ld", c ? ", " : "", p.counts[c].first.c_str(), p.counts[c].second);
+		fprintf(out, "}}");
+	}
+	fprintf(out, "\n], \"total_seconds\": %.6f, \"peak_rss_kb\": %ld}\n", total, peak_rss_kb());
+}
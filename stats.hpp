@@ -0,0 +1,46 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Wall time, peak memory and work counts for each pass of a compile, as
+// printed by --time-report. The driver brackets every pass with begin() and
+// end(); passes that know how much work they did attach it with count().
+
+// Running totals bumped by the symbol and class tables themselves, so every
+// pass that uses them is counted without being told about it
+extern long stat_symtab_lookups;
+extern long stat_classtable_lookups;
+
+class CompileStats
+{
+  public:
+	struct Pass
+	{
+		std::string name;
+		double seconds;
+		long peak_rss_kb;
+		std::vector<std::pair<std::string, long> > counts;
+	};
+
+	CompileStats();
+
+	void begin(const char* pass);
+	void end();
+
+	// Attach a count to the pass that just ended
+	void count(const char* what, long n);
+
+	void report_table(FILE* out);
+	void report_json(FILE* out);
+
+  private:
+	std::vector<Pass> m_passes;
+	double m_start;
+	long m_symtab_start;
+	long m_classtable_start;
+};
+
+#endif //STATS_HPP
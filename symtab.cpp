@@ -1,5 +1,6 @@
 #include <algorithm>
 #include "symtab.hpp"
+#include "stats.hpp"
 #include "stdio.h"
 #include <assert.h>
 #include <string>
@@ -9,18 +10,22 @@
 SymName::SymName(char* const x)
 {
 	m_spelling = x;
+	m_id = Interner::id(x);
+	assert( m_id >= 0 && m_id < identifiers.size() && identifiers.spelling(m_id) == x );
+	m_symbol = NULL;
 	m_parent_attribute = NULL;
 }
 
 SymName::SymName(const SymName & other)
 {
-	m_spelling = strdup(other.m_spelling);
+	m_spelling = other.m_spelling;
+	m_id = other.m_id;
+	m_symbol = NULL;
 	m_parent_attribute = other.m_parent_attribute;
 }
 
 SymName& SymName::operator=(const SymName & other)
 {
-	delete m_spelling;
 	SymName tmp(other);
 	swap(tmp);
 	return *this;
@@ -29,11 +34,12 @@ SymName& SymName::operator=(const SymName & other)
 void SymName::swap(SymName & other)
 {
 	std::swap(m_spelling, other.m_spelling);
+	std::swap(m_id, other.m_id);
 }
 
 SymName::~SymName()
 {
-	delete( m_spelling );
+	// the spelling belongs to identifiers
 }
 
 void SymName::accept(Visitor *v)
@@ -80,21 +86,65 @@ SymTab::~SymTab()
 	delete m_head;
 }
 
-bool SymTab::is_dup_string(const char* name)
+void SymTab::reserve(int id)
 {
-	return m_head->is_dup_string(name);
+	if ( id >= (int)m_visible.size() ) {
+		int n = std::max(id + 1, identifiers.size());
+		m_visible.resize(n, NULL);
+		m_level.resize(n, 0);
+	}
+}
+
+void SymTab::bind(int id, Symbol* s)
+{
+	reserve(id);
+	Binding old = { id, m_visible[id], m_level[id] };
+	m_undo.push_back(old);
+	m_visible[id] = s;
+	m_level[id] = level();
+}
+
+void SymTab::open_level()
+{
+	m_opened.push_back(m_undo.size());
+}
+
+void SymTab::close_level()
+{
+	size_t start = m_opened.back();
+	while ( m_undo.size() > start ) {
+		Binding &b = m_undo.back();
+		m_visible[b.id] = b.symbol;
+		m_level[b.id] = b.level;
+		m_undo.pop_back();
+	}
+	m_opened.pop_back();
 }
 
 void SymTab::open_scope()
 {
     m_cur_scope = m_cur_scope->open_scope();
     assert( m_cur_scope != NULL );
+    open_level();
 }
 
 void SymTab::open_scope(SymScope* parent)
 {
+    SymScope* last = m_cur_scope;
     m_cur_scope = parent->open_scope(m_cur_scope);
     assert( m_cur_scope != NULL );
+    open_level();
+
+    // names from the scope being left are not visible from the new one,
+    // and the new one starts out with everything the parent makes visible
+    SymScope::ScopeTableType hidden;
+    last->visible(hidden);
+    SymScope::ScopeTableType::iterator si;
+    for( si = hidden.begin(); si != hidden.end(); ++si )
+        if ( m_cur_scope->m_scopetable.find(si->first) == m_cur_scope->m_scopetable.end() )
+            bind(si->first, NULL);
+    for( si = m_cur_scope->m_scopetable.begin(); si != m_cur_scope->m_scopetable.end(); ++si )
+        bind(si->first, si->second.symbol);
 }
 
 void SymTab::close_scope()
@@ -103,43 +153,69 @@ void SymTab::close_scope()
     assert( m_cur_scope != m_head );
     assert( m_cur_scope != NULL );
 
+    close_level();
     m_cur_scope = m_cur_scope->close_scope();
 }
 
 bool SymTab::exist(const char* name )
 {
 	assert( name != NULL );
-	return m_cur_scope->exist( name );
+	return lookup( name ) != NULL;
 }
 
 bool SymTab::insert(const char* name, Symbol * s )
 {
 	assert( name != NULL );
+	return insert( Interner::id(identifiers.intern(name)), s );
+}
+
+bool SymTab::insert(SymName * name, Symbol * s )
+{
+	assert( name != NULL );
+	return insert( name->id(), s );
+}
+
+bool SymTab::insert(int id, Symbol * s )
+{
 	assert( s != NULL );
-	// the assert below fails, it is because you tried to insert
-	// a pointer to a string that is already in the SymTab.  You 
-	// can have duplicate names, but each needs to reside it it's
-	// own chunk of memory (see example)
-	//assert( is_dup_string(name) ); 
-	Symbol* r = m_cur_scope->insert( name, s );
-	if ( r == NULL ) return true;
-	else return false;
+	Symbol* r = m_cur_scope->insert( id, s );
+	if ( r != NULL ) return false;
+	bind( id, s );
+	return true;
 }
 
 bool SymTab::insert_in_parent_scope(const char* name, Symbol * s )
 {
 	assert( name != NULL );
 	assert( s != NULL );
-	// the assert below fails, it is because you tried to insert
-	// a pointer to a string that is already in the SymTab.  You 
-	// can have duplicate names, but each needs to reside it it's
-	// own chunk of memory (see example)
-	//assert( is_dup_string(name) ); 
-	// make sure there is an actual parent scope
+	// make sure there is an actual parent scope, and that it is the
+	// scope that will be current again once this one is closed
 	assert( m_cur_scope->m_parent != NULL );	
-	Symbol* r = m_cur_scope->m_parent->insert( name, s );
-	if ( r == NULL ) return true;
-	else return false;
+	assert( m_cur_scope->m_parent == m_cur_scope->m_last );
+	int id = Interner::id(identifiers.intern(name));
+	Symbol* r = m_cur_scope->m_parent->insert( id, s );
+	if ( r != NULL ) return false;
+
+	// the binding belongs to the parent's level: it is logged just before
+	// the current level starts, and if the current level hides it, the
+	// log entry that will uncover it is pointed at s instead
+	reserve(id);
+	Binding under = { id, m_visible[id], m_level[id] };
+	if ( m_level[id] == level() ) {
+		for( size_t i = m_opened.back(); i < m_undo.size(); i++ )
+			if ( m_undo[i].id == id ) {
+				under = m_undo[i];
+				m_undo[i].symbol = s;
+				m_undo[i].level = level() - 1;
+				break;
+			}
+	} else {
+		m_visible[id] = s;
+		m_level[id] = level() - 1;
+	}
+	m_undo.insert( m_undo.begin() + m_opened.back(), under );
+	m_opened.back()++;
+	return true;
 }
 
 SymScope* SymTab::get_current_scope()
@@ -150,13 +226,20 @@ SymScope* SymTab::get_current_scope()
 Symbol* SymTab::lookup( const char * name )
 {
 	assert( name != NULL );
-	return m_cur_scope->lookup( name );
+	return lookup( identifiers.find(name) );
 }
 
 Symbol* SymTab::lookup( SymName * name )
 {
 	assert( name != NULL );
-	return m_cur_scope->lookup( name->spelling() );
+	return lookup( name->id() );
+}
+
+Symbol* SymTab::lookup( int id )
+{
+	stat_symtab_lookups++;
+	if ( id < 0 || id >= (int)m_visible.size() ) return NULL;
+	return m_visible[id];
 }
 
 
@@ -170,37 +253,43 @@ void SymTab::dump( FILE* f )
 SymScope::SymScope()
 {
     m_parent = NULL;
+    m_last = NULL;
+    m_flat = false;
 }
 
-SymScope::SymScope(SymScope * last, SymScope * parent)
+SymScope::SymScope(SymScope * last, SymScope * parent, bool flat)
 {
     m_last = last;
     m_parent = parent;
+    m_flat = false;
     if (parent!=NULL) {
         parent->add_child(this);
+        if (flat) {
+            parent->visible(m_scopetable);
+            m_flat = true;
+        }
     }
 }
 
 SymScope::~SymScope()
 {
-	//delete the keys, but not the symbols (symbols are linked elsewhere)
-	ScopeTableType::iterator si, this_si;
-
-	si = m_scopetable.begin();
-	while ( si!=m_scopetable.end() )
+	//the symbols are not deleted (symbols are linked elsewhere)
+	//but all the children are
+	vector<SymScope*>::iterator li;
+	for( li=m_child.begin(); li!=m_child.end(); ++li )
 	{
-		std::string oldkey = si->first;
-		this_si = si;
-		++si;
-
-		m_scopetable.erase( this_si );
+		delete *li;
 	}
+}
 
-	//now delete all the children
-	list<SymScope*>::iterator li;
-	for( li=m_child.begin(); li!=m_child.end(); ++li )
+void SymScope::visible(ScopeTableType &table)
+{
+	if ( !m_flat && m_parent != NULL ) m_parent->visible(table);
+	ScopeTableType::iterator si;
+	for( si = m_scopetable.begin(); si != m_scopetable.end(); ++si )
 	{
-		delete *li;
+		Member inherited = { si->second.symbol, false };
+		table[si->first] = inherited;
 	}
 }
 
@@ -217,42 +306,22 @@ void SymScope::dump(FILE* f, int nest_level)
 
 	for( si = m_scopetable.begin(); si != m_scopetable.end(); ++si )
 	{
+		if ( !si->second.own ) continue;
 		//indent appropriately
 		for( int i=0; i<nest_level; i++ ) { fprintf(f,"\t"); }
-		fprintf( f, "| %s \n", si->first.c_str() );
+		fprintf( f, "| %s \n", identifiers.spelling(si->first) );
 	}
 	for( int i=0; i<nest_level; i++ ) { fprintf(f,"\t"); }
 	fprintf(f,"+-------------\n\n");
 
 	//now print all the children
-	list<SymScope*>::iterator li;
+	vector<SymScope*>::iterator li;
 	for( li=m_child.begin(); li!=m_child.end(); ++li )
 	{
 		(*li)->dump(f, nest_level+1);
 	}
 }
 
-bool SymScope::is_dup_string(const char* name)
-{
-	ScopeTableType::iterator si;
-
-	si = m_scopetable.find( name );
-	if ( si != m_scopetable.end() ) {
-		//check if the pointers match
-		if ( si->first == name ) return false;
-	}
-
-	list<SymScope*>::iterator li;
-	for( li=m_child.begin(); li!=m_child.end(); ++li )
-	{
-		bool r = (*li)->is_dup_string(name);
-		if ( r==false ) return false;
-	}
-
-	//if it gets this far, there is no duplicate
-	return true;
-}
-
 void SymScope::add_child(SymScope* c) 
 {
 	m_child.push_back(c);
@@ -266,7 +335,7 @@ SymScope* SymScope::open_scope()
 
 SymScope* SymScope::open_scope(SymScope* last)
 {
-    return new SymScope(last, this);
+    return new SymScope(last, this, true);
 }
 
 SymScope* SymScope::close_scope()
@@ -285,31 +354,43 @@ bool SymScope::exist( const char* name )
 
 Symbol* SymScope::insert( const char* name, Symbol * s )
 {
-	pair<ScopeTableType::iterator,bool> iret;
-	typedef pair<std::string,Symbol*> hpair;
-	iret = m_scopetable.insert( hpair(std::string(name),s) );
-	if( iret.second == true ) {
-		//insert was successfull
-		return NULL;
-	} else {
+	return insert( Interner::id(identifiers.intern(name)), s );
+}
+
+Symbol* SymScope::insert( int id, Symbol * s )
+{
+	Member &m = m_scopetable[id];
+	if ( m.symbol != NULL && m.own ) {
 		//cannot insert, there was a duplicate entry
 		//return a pointer to the conflicting symbol
-		return iret.first->second;
-	}	
+		return m.symbol;
+	}
+	//insert was successfull, possibly hiding an inherited member
+	m.symbol = s;
+	m.own = true;
+	return NULL;
 }
  
 Symbol* SymScope::lookup( const char * name )
+{
+	//a name that was never interned cannot have been inserted
+	int id = identifiers.find(name);
+	if ( id == Interner::no_id ) return NULL;
+	return lookup(id);
+}
+
+Symbol* SymScope::lookup( int id )
 {
 	//first check the current table;
 	ScopeTableType::const_iterator i;
-	i = m_scopetable.find( std::string(name) );
+	i = m_scopetable.find( id );
 	if ( i != m_scopetable.end() ) {
-		return i->second;
+		return i->second.symbol;
 	}
 
-	//failing that, check all the parents;
-	if ( m_parent != NULL ) {
-		return m_parent->lookup(name);
+	//failing that, check the parents, unless they were copied in;
+	if ( m_parent != NULL && !m_flat ) {
+		return m_parent->lookup(id);
 	} else {
 		//if this has no parents, then it cannot be found
 		return NULL;
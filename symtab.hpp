@@ -3,6 +3,7 @@
 
 #include "ast.hpp"
 #include "attribute.hpp"
+#include "intern.hpp"
 #include <cstring>
 #include <iostream>
 #include <vector>
@@ -15,20 +16,22 @@ typedef AllType Symbol;
 
 class SymName 
 {
-  char* m_spelling; // "name" of the symbol
+  char* m_spelling; // "name" of the symbol, interned
+  int m_id;         // its id in identifiers
   Symbol* m_symbol; // pointer to the symbol for this name
 
   public:
 
   SymName(const SymName &);
   SymName &operator=(const SymName &);
-  SymName(char* const x);
+  SymName(char* const x); // x must come from identifiers.intern()
   ~SymName();
   virtual void accept(Visitor *v);
   virtual SymName *clone() const;
   void swap(SymName &);
 
   const char* spelling();
+  int id() const { return m_id; }
   const Symbol* symbol();
   void set_symbol( Symbol* symbol );
 
@@ -38,27 +41,35 @@ class SymName
 // this is one-level of scope for the SymTab
 // it is not defined in the hpp file because it 
 // is only used in the implementation of SymTab
-
-//comparison structure for strings
-struct eqstr {
-        bool operator()(const char* s1, const char* s2) const
-                { return strcmp(s1, s2) == 0; }
-                };
+//
+// A scope opened on top of a class scope (open_scope(SymScope*)) copies
+// everything visible from that class into its own table when it is made,
+// marked as not its own, so looking up an inherited member is one probe
+// however deep the hierarchy is. Other scopes hold only their own names
+// and ask their parent for the rest.
 
 class SymScope
 {
+    struct Member
+    {
+        Symbol* symbol;
+        bool own;       // inserted here rather than inherited
+    };
+    typedef std::unordered_map<int, Member> ScopeTableType; // by identifier id
 
     SymScope* m_parent;
     SymScope* m_last;
-    list<SymScope*> m_child;
-    typedef std::unordered_map<string, Symbol*, std::hash<std::string> > ScopeTableType;
+    vector<SymScope*> m_child;
     ScopeTableType m_scopetable;
+    bool m_flat; // m_scopetable already holds all that the parents make visible
+
+    // add everything visible from this scope to table, as inherited
+    void visible(ScopeTableType &table);
 
     public:
     SymScope* parent();
     void add_child(SymScope* c);
-    SymScope(SymScope* last, SymScope * parent);
-    bool is_dup_string(const char* name); //used for error check
+    SymScope(SymScope* last, SymScope * parent, bool flat = false);
 
     void dump( FILE* f, int nest_level );
     SymScope* open_scope();
@@ -66,7 +77,9 @@ class SymScope
     SymScope* close_scope();
     bool exist( const char* name );
     Symbol* insert( const char* name, Symbol * s );
+    Symbol* insert( int id, Symbol * s );
     Symbol* lookup( const char * name );
+    Symbol* lookup( int id );
 
     SymScope();
     ~SymScope();
@@ -77,15 +90,37 @@ class SymScope
 // This is the symbol table header which is similar
 // to the interface described in class.  There is a
 // open and close scope to grow a symbol table tree.
-// lookup and exist recurisively search all of the
-// parent scopes, while insert considers only the
-// current scope.  An example chunk of code is below
+// lookup and exist search the current scope and all
+// of its parents, while insert considers only the
+// current scope.
+//
+// Lookups through the SymTab do not walk the scope tree. Every identifier
+// id has a slot holding the symbol it names right now; insert overwrites
+// the slot and logs what it held, and close_scope replays the log back to
+// where the scope was opened. Opening a scope on a class binds the class's
+// members, inherited ones included, in one go.
 class SymTab
 {
     private:
     SymScope* m_head;
     SymScope* m_cur_scope;
-    bool is_dup_string(const char*);
+
+    struct Binding
+    {
+        int id;
+        Symbol* symbol;
+        int level;
+    };
+    vector<Symbol*> m_visible;  // by identifier id, NULL if not visible
+    vector<int> m_level;        // by identifier id, the scope level that bound it
+    vector<Binding> m_undo;     // what each binding replaced
+    vector<size_t> m_opened;    // where each open scope starts in m_undo
+
+    int level() { return (int)m_opened.size(); }
+    void reserve(int id);
+    void bind(int id, Symbol* s);
+    void open_level();
+    void close_level();
 
     public:
 
@@ -102,20 +137,22 @@ class SymTab
 
     //tries to insert a pointer to s into the symbol table and
     //returns true if successful.
-    //name should be a "fresh" copy, meaning that the SymTab
-    //will keep track of the memory pointed to by name and free
-    //it in the destructor.  name should not point to some memory
-    //that has already been inserted into the symtab (see example)
+    //names are interned, so name may be any string and the
+    //SymTab never keeps or frees the memory it points to
     bool insert(const char* name, Symbol * s );
+    bool insert(SymName * name, Symbol * s );
+    bool insert(int id, Symbol * s );
 
     //does an insert into the parent scope of the working scope
-    //(it will have an assert failure if there is no parent scope)
+    //(it will have an assert failure if there is no parent scope,
+    //or if the working scope was opened on some other scope)
     bool insert_in_parent_scope(const char* name, Symbol * s );
 
     //tries to locate name in the current SymTab and all
     //of the parent SymTabs
     Symbol* lookup( const char * name );
     Symbol* lookup( SymName * name );
+    Symbol* lookup( int id );
 
     //get current scope
     SymScope* get_current_scope();
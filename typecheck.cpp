@@ -3,9 +3,12 @@
 #include "symtab.hpp"
 #include "primitive.hpp"
 #include "classhierarchy.hpp"
+#include "astcast.hpp"
+#include "compilecache.hpp"
 #include "assert.h"
 #include <typeinfo>
 #include <stdio.h>
+#include <vector>
 
 /***********
 
@@ -22,11 +25,28 @@
 
 *****/
 
+// Typecheck does not stop at the first error: each one is recorded and
+// checking carries on, and report() prints them all at the end. An
+// expression whose type could not be worked out (an undefined name, say)
+// is given bt_undef, and checks that involve it are skipped, so one
+// mistake is reported once rather than at every use.
+//
+// With a cache, each class is looked up before it is checked (see
+// compilecache.hpp). A class whose IR is found passed these checks when it
+// was stored, against the same interfaces, so only its fields and method
+// headers are read, for the classes after it.
 class Typecheck : public Visitor {
     private:
     FILE* m_errorfile;
     SymTab* m_symboltable;
     ClassTable* m_classtable;
+
+    CachedClasses* m_cached;    // NULL if there is no cache
+    size_t m_class;             // index of the class being checked
+    bool m_skip_bodies;         // its IR was found, so its methods' bodies are not checked
+    bool m_in_method;
+    std::string m_interface;    // the interface of the class being checked
+    std::string m_interfaces;   // a digest of the interfaces of the classes before it
     
     const char * bt_to_string(Basetype bt) {
         switch (bt) {
@@ -61,11 +81,29 @@ class Typecheck : public Visitor {
         
         no_class_method,
     };
+
+    struct Diagnostic {
+        errortype e;
+        int lineno;
+    };
+    std::vector<Diagnostic> m_diagnostics;
+    int m_error_limit; // stop once this many are found; 0 for no limit
     
     // Throw errors using this method
     void t_error( errortype e, Attribute a ) 
     {
-        fprintf(m_errorfile,"on line number %d, ", a.lineno );
+        Diagnostic d = { e, a.lineno };
+        m_diagnostics.push_back(d);
+        if((int)m_diagnostics.size() == m_error_limit) {
+            report();
+            fprintf(m_errorfile,"too many errors, stopping\n");
+            exit(1);
+        }
+    }
+
+    void print_error( errortype e, int lineno )
+    {
+        fprintf(m_errorfile,"on line number %d, ", lineno );
         
         switch( e ) {
             case no_program: fprintf(m_errorfile,"error: no Program class\n"); break;
@@ -89,15 +127,91 @@ class Typecheck : public Visitor {
             
             default: fprintf(m_errorfile,"error: no good reason\n"); break;
         }
-        exit(1);
+    }
+
+    // Whether a use of type where an expected is wanted is an error. A
+    // bt_undef type was already reported where it came from.
+    bool mismatched(const AllType& type, Basetype expected)
+    {
+        if(type.baseType == bt_undef) return false;
+        return type.baseType!=expected && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=expected);
+    }
+
+    // Check a call's arguments against func's parameters; one error per call
+    void check_args(Symbol* func, list<Expression_ptr>* args, Attribute a)
+    {
+        Items<Expression_ptr>& l = items_of(args);
+        unsigned n;
+        for(n=0; n<l.size(); n++) {
+            if(n==func->methodType.argsType.size()) {
+                t_error(call_narg_mismatch, a);
+                return;
+            }
+            Basetype b=func->methodType.argsType[n].baseType;
+            Basetype t=l[n]->m_attribute.m_type.baseType;
+            if(t != b && t != bt_undef && b != bt_undef) {
+                t_error(call_args_mismatch, a);
+                return;
+            }
+        }
+        if(n<func->methodType.argsType.size()) t_error(call_narg_mismatch, a);
+    }
+
+    // Look the current class up in the cache; true if its IR was found
+    bool find_class()
+    {
+        CompileCache* cache = m_cached->cache;
+        std::string key = cache->ir_key(m_cached->config, m_interfaces, m_cached->sources[m_class]);
+        std::string text;
+        // a store is renamed into place whole, but a file cut short some
+        // other way must not count
+        bool found = cache->find(key, text) && text.size() >= 4 && text.compare(text.size() - 4, 4, "end\n") == 0;
+        if(!found) text.clear();
+        m_cached->keys.push_back(key);
+        m_cached->ir.push_back(text);
+        if(found) cache->ir_hits++;
+        else cache->ir_misses++;
+        return found;
+    }
+
+    static std::string type_text(const CompoundType& t)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d ", t.baseType);
+        return buf + std::string(t.baseType == bt_object && t.classID != NULL ? t.classID : "-");
+    }
+
+    // Give a call the return type of func, or bt_undef if it could not be found
+    void set_call_type(Attribute& a, Symbol* func)
+    {
+        if(func==NULL) {
+            a.m_type.baseType=bt_undef;
+            a.m_type.classType.baseType=bt_undef;
+            return;
+        }
+        a.m_type.baseType=func->methodType.returnType.baseType;
+        a.m_type.classType.baseType=func->methodType.returnType.baseType;
+        a.m_type.classType.classID=func->methodType.returnType.classID;
     }
     
     public:
     
-    Typecheck(FILE* errorfile, SymTab* symboltable,ClassTable*ct) {
+    Typecheck(FILE* errorfile, SymTab* symboltable,ClassTable*ct, int error_limit, CachedClasses* cached) {
         m_errorfile = errorfile;
         m_symboltable = symboltable;
         m_classtable = ct;
+        m_error_limit = error_limit;
+        m_cached = cached;
+        m_class = 0;
+        m_skip_bodies = false;
+        m_in_method = false;
+    }
+
+    // Print every error found, in the order they were found; returns how many
+    int report() {
+        for(size_t i = 0; i < m_diagnostics.size(); i++)
+            print_error(m_diagnostics[i].e, m_diagnostics[i].lineno);
+        return (int)m_diagnostics.size();
     }
 
     //=====================================================================================================================
@@ -106,12 +220,16 @@ class Typecheck : public Visitor {
 
         // Iterate through all classes for visiting
         char* const prog = (char*)"Program";
-        list<Class_ptr>::iterator i;
+        Items<Class_ptr>& l = items_of(p->m_class_list);
         Class_ptr ptr;
-        for(i=p->m_class_list->begin(); i!=p->m_class_list->end(); ++i) {
-            ptr=*i;
-            if(m_classtable->exist(prog)) // Program class cannot not be last
+        bool reported = false;
+        for(size_t i = 0; i < l.size(); i++) {
+            ptr=l[i];
+            if(m_classtable->exist(prog) && !reported) { // Program class cannot not be last
                 t_error(no_program, p->m_attribute);
+                reported = true;
+            }
+            m_class = i;
             ptr->accept(this);
         }
 
@@ -128,24 +246,41 @@ class Typecheck : public Visitor {
 
 
         // Fetch classname and check for duplicate declarations
-        ClassName* id = ((dynamic_cast<ClassIDImpl *>(p->m_classid_1))->m_classname);
-        if(m_classtable->exist(id)) t_error(dup_ident_name, p->m_attribute);
+        // A duplicate is still checked, but the first class keeps the name
+        ClassName* id = classname_of(p->m_classid_1);
+        bool dup = m_classtable->exist(id);
+        if(dup) t_error(dup_ident_name, p->m_attribute);
 
         // Check if there is a superclass, and add to table
+        ClassName* superclassID = NULL;
+        ClassNode* superclass = NULL;
         if(p->m_classid_2!=NULL) { // If superclass isn't null, check to see if it exists before adding to table
-            ClassName* superclassID = ((dynamic_cast<ClassIDImpl*>(p->m_classid_2))->m_classname);
-            ClassNode* superclass = m_classtable->lookup(superclassID);
-            if(superclass==NULL) t_error(sym_name_undef, p->m_attribute);
-            // add to table, open scope in superclass scope
+            superclassID = classname_of(p->m_classid_2);
+            superclass = m_classtable->lookup(superclassID);
+            if(superclass==NULL) t_error(sym_name_undef, p->m_attribute); // checked as if it had none
+        }
+        if(superclass!=NULL) { // add to table, open scope in superclass scope
             m_symboltable->open_scope(superclass->scope);
-            m_classtable->insert(id, superclassID, p,  m_symboltable->get_current_scope());
+            if(!dup) m_classtable->insert(id, superclassID, p,  m_symboltable->get_current_scope());
         } else { // If no superclass, add to table in default scope with no parent
             m_symboltable->open_scope();
-            m_classtable->insert(id, NULL, p, m_symboltable->get_current_scope());
+            if(!dup) m_classtable->insert(id, NULL, p, m_symboltable->get_current_scope());
         }
 
+        // An unchanged class that was stored before needs only its interface
+        m_skip_bodies = m_cached != NULL && find_class();
+        m_interface = std::string("class ") + id->spelling() + " from " + (superclassID != NULL ? superclassID->spelling() : "-") + "\n";
+
         // Visit the children
-        p->visit_children(this);
+        p->m_classid_1->accept(this);
+        if(p->m_classid_2!=NULL) p->m_classid_2->accept(this);
+        visit_items(p->m_declaration_list, this);
+        visit_items(p->m_method_list, this);
+        m_skip_bodies = false;
+        if(m_cached != NULL) {
+            m_interfaces += m_interface;
+            m_interfaces = CompileCache::digest(m_interfaces.data(), m_interfaces.size());
+        }
 
         // If name is "Program", check for a function named "Start", with no arguments
         if(strcmp(id->spelling(), "Program") == 0) {
@@ -170,21 +305,23 @@ class Typecheck : public Visitor {
 
 
         // Visit the children
-        p->visit_children(this);
+        visit_items(p->m_variableid_list, this);
+        p->m_type->accept(this);
 
         // Set type
         p->m_attribute.m_type=p->m_type->m_attribute.m_type;
 
         // Iterate through attached IDs and add to table using set type
-        list<VariableID_ptr>::iterator i;
+        Items<VariableID_ptr>& l = items_of(p->m_variableid_list);
         VariableID_ptr v;
         SymName* n;
-        for(i=p->m_variableid_list->begin(); i!=p->m_variableid_list->end(); ++i){
-            v=*i;
-            n = (dynamic_cast<VariableIDImpl *>(v))->m_symname;
+        for(size_t i = 0; i < l.size(); i++){
+            v=l[i];
+            n = symname_of(v);
             // Add to symbol table
-            bool success = m_symboltable->insert(n->spelling(), (Symbol*)&(p->m_attribute.m_type));
+            bool success = m_symboltable->insert(n, (Symbol*)&(p->m_attribute.m_type));
             if(!success) t_error(dup_ident_name, p->m_attribute); // Ensure no duplicates in scope
+            if(!m_in_method) m_interface += std::string("field ") + n->spelling() + " " + type_text(p->m_attribute.m_type.classType) + "\n";
         }
     }
 
@@ -195,7 +332,7 @@ class Typecheck : public Visitor {
         // Add to symbol table. Symbol type info will be altered as we go
         // Have to do it this way for method to be at class scope
         p->m_methodid->accept(this);
-        bool success = m_symboltable->insert(   dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname->spelling(),
+        bool success = m_symboltable->insert(   symname_of(p->m_methodid),
                                                 (Symbol*)&(p->m_attribute.m_type));
         if(!success) t_error(dup_ident_name, p->m_attribute); // Ensure no duplicates in scope
 
@@ -207,17 +344,29 @@ class Typecheck : public Visitor {
         p->m_attribute.m_type.baseType=bt_function;
         p->m_attribute.m_type.methodType.returnType.baseType=p->m_type->m_attribute.m_type.baseType;
         p->m_attribute.m_type.methodType.returnType.classID=p->m_type->m_attribute.m_type.classType.classID;
-        list<Parameter_ptr>::iterator i;
+        Items<Parameter_ptr>& l = items_of(p->m_parameter_list);
         Parameter_ptr ptr;
-        for(i = p->m_parameter_list->begin(); i != p->m_parameter_list->end(); ++i) {
-            ptr=*i;
+        for(size_t i = 0; i < l.size(); i++) {
+            ptr=l[i];
             ptr->accept(this);
             p->m_attribute.m_type.methodType.argsType.push_back(ptr->m_attribute.m_type.classType);
         }
+        MethodType& type = p->m_attribute.m_type.methodType;
+        m_interface += std::string("method ") + symname_of(p->m_methodid)->spelling() + " " + type_text(type.returnType);
+        for(size_t k = 0; k < type.argsType.size(); k++) m_interface += ", " + type_text(type.argsType[k]);
+        m_interface += "\n";
+        if(m_skip_bodies) {
+            m_symboltable->close_scope();
+            return;
+        }
 
         // Visit body now that the function is fully in the table. Return type checking
+        m_in_method = true;
         p->m_methodbody->accept(this);
-        if(p->m_methodbody->m_attribute.m_type.baseType!=p->m_type->m_attribute.m_type.baseType)
+        m_in_method = false;
+        if(p->m_methodbody->m_attribute.m_type.baseType==bt_undef || p->m_type->m_attribute.m_type.baseType==bt_undef)
+            ; // already reported
+        else if(p->m_methodbody->m_attribute.m_type.baseType!=p->m_type->m_attribute.m_type.baseType)
             t_error(ret_type_mismatch, p->m_attribute);
         else if(p->m_type->m_attribute.m_type.baseType==bt_object) {
             if(strcmp(  p->m_type->m_attribute.m_type.classType.classID,
@@ -234,7 +383,9 @@ class Typecheck : public Visitor {
     void visitMethodBodyImpl(MethodBodyImpl *p) {
 
         // Visit the children
-        p->visit_children(this);
+        visit_items(p->m_declaration_list, this);
+        visit_items(p->m_statement_list, this);
+        p->m_return->accept(this);
 
         // Set type to return type for return type checking
         p->m_attribute.m_type=p->m_return->m_attribute.m_type;
@@ -248,7 +399,7 @@ class Typecheck : public Visitor {
         p->visit_children(this);
 
         // Get name
-        const char* name = dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling();
+        SymName* name = symname_of(p->m_variableid);
 
         // Add to symbol table under type specifed by type
         p->m_attribute.m_type=p->m_type->m_attribute.m_type;
@@ -262,15 +413,18 @@ class Typecheck : public Visitor {
     void visitAssignment(Assignment *p) {
 
         // Make sure the assigned identifier exists and is not a function symbol
-        Symbol* s = m_symboltable->lookup(dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling());
+        Symbol* s = m_symboltable->lookup(symname_of(p->m_variableid));
         if(s==NULL) t_error(sym_name_undef, p->m_attribute);
-        if(s->baseType==bt_function) t_error(sym_type_mismatch, p->m_attribute);
+        else if(s->baseType==bt_function) t_error(sym_type_mismatch, p->m_attribute);
 
         // Visit the children
         p->visit_children(this);
+        if(s==NULL || s->baseType==bt_function) return;
 
         // Check the symbol type to the expression type
-        if(s->baseType != p->m_expression->m_attribute.m_type.baseType)
+        if(s->baseType==bt_undef || p->m_expression->m_attribute.m_type.baseType==bt_undef)
+            ; // already reported
+        else if(s->baseType != p->m_expression->m_attribute.m_type.baseType)
             t_error(incompat_assign, p->m_attribute);
         else if(s->baseType == bt_function) {
             if(strcmp(s->classType.classID, p->m_expression->m_attribute.m_type.classType.classID) != 0)
@@ -286,7 +440,8 @@ class Typecheck : public Visitor {
         p->visit_children(this);
 
         // Make sure the conditional predicate is a bool
-        if(p->m_expression->m_attribute.m_type.baseType != bt_boolean) t_error(if_pred_err, p->m_attribute);
+        Basetype b = p->m_expression->m_attribute.m_type.baseType;
+        if(b != bt_boolean && b != bt_undef) t_error(if_pred_err, p->m_attribute);
     }
 
     //=====================================================================================================================
@@ -353,8 +508,13 @@ class Typecheck : public Visitor {
     void visitTObject(TObject *p) {
 
         // Make sure class exists
-        ClassNode* n = m_classtable->lookup((dynamic_cast<ClassIDImpl*>(p->m_classid)->m_classname));
-        if(n==NULL) t_error(sym_name_undef, p->m_attribute);
+        ClassNode* n = m_classtable->lookup(classname_of(p->m_classid));
+        if(n==NULL) {
+            t_error(sym_name_undef, p->m_attribute);
+            p->m_attribute.m_type.baseType=bt_undef;
+            p->m_attribute.m_type.classType.baseType=bt_undef;
+            return;
+        }
 
         // Set type
         p->m_attribute.m_type.baseType=bt_object;
@@ -404,10 +564,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to integer
@@ -423,10 +583,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to integer
@@ -442,10 +602,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to integer
@@ -461,10 +621,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to integer
@@ -480,10 +640,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are boolean types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_boolean && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_boolean))
+        if(mismatched(type, bt_boolean))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_boolean && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_boolean))
+        if(mismatched(type, bt_boolean))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to boolean
@@ -499,10 +659,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to boolean
@@ -518,10 +678,10 @@ class Typecheck : public Visitor {
 
         // Ensure right and left sides are integer types
         AllType type = p->m_expression_1->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
         type = p->m_expression_2->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to boolean
@@ -537,7 +697,7 @@ class Typecheck : public Visitor {
 
         // Ensure argument is of boolean type
         AllType type = p->m_expression->m_attribute.m_type;
-        if(type.baseType!=bt_boolean && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_boolean))
+        if(mismatched(type, bt_boolean))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to boolean
@@ -553,7 +713,7 @@ class Typecheck : public Visitor {
 
         // Ensure argument is of integer type
         AllType type = p->m_expression->m_attribute.m_type;
-        if(type.baseType!=bt_integer && (type.baseType!=bt_function&&type.methodType.returnType.baseType!=bt_integer))
+        if(mismatched(type, bt_integer))
             t_error(expr_type_err, p->m_attribute);
 
         // Set this type to integer
@@ -565,44 +725,40 @@ class Typecheck : public Visitor {
     void visitMethodCall(MethodCall *p) {
 
         // Visit the children first, so everything has its type
-        p->visit_children(this);
+        p->m_variableid->accept(this);
+        p->m_methodid->accept(this);
+        visit_items(p->m_expression_list, this);
 
         // Make sure called variable exists and is of type 'class'
-        Symbol* s = m_symboltable->lookup(dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname->spelling());
+        Symbol* s = m_symboltable->lookup(symname_of(p->m_variableid));
         if(s==NULL) {
             t_error(sym_name_undef, p->m_attribute);
+            set_call_type(p->m_attribute, NULL);
+            return;
+        }
+        if(s->baseType!=bt_object) {
+            if(s->baseType!=bt_undef) t_error(sym_type_mismatch, p->m_attribute);
+            set_call_type(p->m_attribute, NULL);
+            return;
         }
-        char* const name = (char*)(s->classType.classID);
-        if(s->baseType!=bt_object) t_error(sym_type_mismatch, p->m_attribute);
-        else if(strcmp(s->classType.classID, name)!=0) t_error(sym_type_mismatch, p->m_attribute);
 
         // Grab referenced class
-        ClassNode* c = m_classtable->lookup(name);
+        ClassNode* c = m_classtable->lookup(s->classType.classID);
         assert(c!=NULL); // Class existence was checked in variable declaration
 
         // Make sure called function is a method in that class
-        Symbol* func = c->scope->lookup(dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname->spelling());
+        Symbol* func = c->scope->lookup(symname_of(p->m_methodid)->id());
         if(func==NULL) t_error(no_class_method, p->m_attribute);
-        if(func->baseType != bt_function) t_error(sym_type_mismatch, p->m_attribute);
+        else if(func->baseType != bt_function) {
+            t_error(sym_type_mismatch, p->m_attribute);
+            func = NULL;
+        }
 
         // Check types in parameters
-        list<Expression_ptr>::iterator i;
-        Expression_ptr e;
-        Basetype b;
-        int n;
-        for(i=p->m_expression_list->begin(), n=0; i!=p->m_expression_list->end(); ++i, n++) {
-            e=*i;
-            if(n==func->methodType.argsType.size()) {n--; t_error(call_narg_mismatch, p->m_attribute);}
-            b=func->methodType.argsType[n].baseType;
-            if((e->m_attribute.m_type.baseType) != b)
-                    t_error(call_args_mismatch, p->m_attribute);
-        }
-        if(n<func->methodType.argsType.size()) t_error(call_narg_mismatch, p->m_attribute);
+        if(func!=NULL) check_args(func, p->m_expression_list, p->m_attribute);
 
         // Set type
-        p->m_attribute.m_type.baseType=func->methodType.returnType.baseType;
-        p->m_attribute.m_type.classType.baseType=func->methodType.returnType.baseType;
-        p->m_attribute.m_type.classType.classID=func->methodType.returnType.classID;
+        set_call_type(p->m_attribute, func);
     }
 
     //=====================================================================================================================
@@ -610,31 +766,22 @@ class Typecheck : public Visitor {
     void visitSelfCall(SelfCall *p) {
 
         // Visit the children first, so everything has its type
-        p->visit_children(this);
+        p->m_methodid->accept(this);
+        visit_items(p->m_expression_list, this);
 
         // Make sure called function is a method in this class
-        Symbol* func = m_symboltable->lookup(dynamic_cast<MethodIDImpl*>(p->m_methodid)->m_symname);
+        Symbol* func = m_symboltable->lookup(symname_of(p->m_methodid));
         if(func==NULL) t_error(no_class_method, p->m_attribute);
-        if(func->baseType != bt_function) t_error(sym_type_mismatch, p->m_attribute);
+        else if(func->baseType != bt_function) {
+            t_error(sym_type_mismatch, p->m_attribute);
+            func = NULL;
+        }
 
         // Check types in parameters
-        list<Expression_ptr>::iterator i;
-        Expression_ptr e;
-        Basetype b;
-        int n;
-        for(i=p->m_expression_list->begin(), n=0; i!=p->m_expression_list->end(); ++i, n++) {
-            e=*i;
-            if(n==func->methodType.argsType.size()) {n--; t_error(call_narg_mismatch, p->m_attribute);}
-            b=func->methodType.argsType[n].baseType;
-            if((e->m_attribute.m_type.baseType) != (b))
-                    t_error(call_args_mismatch, p->m_attribute);
-        }
-        if(n<func->methodType.argsType.size()) t_error(call_narg_mismatch, p->m_attribute);
+        if(func!=NULL) check_args(func, p->m_expression_list, p->m_attribute);
 
         // Set Type
-        p->m_attribute.m_type.baseType=func->methodType.returnType.baseType;
-        p->m_attribute.m_type.classType.baseType=func->methodType.returnType.baseType;
-        p->m_attribute.m_type.classType.classID=func->methodType.returnType.classID;
+        set_call_type(p->m_attribute, func);
     }
 
     //=====================================================================================================================
@@ -642,15 +789,16 @@ class Typecheck : public Visitor {
     void visitVariable(Variable *p) {
 
         // Make sure VarID is in symbol table and is not a function
-        Symbol *s = m_symboltable->lookup(dynamic_cast<VariableIDImpl*>(p->m_variableid)->m_symname);
+        Symbol *s = m_symboltable->lookup(symname_of(p->m_variableid));
         if(s==NULL) t_error(sym_name_undef, p->m_attribute);
-        if(s->baseType == bt_function) t_error(sym_type_mismatch, p->m_attribute);
+        else if(s->baseType == bt_function) t_error(sym_type_mismatch, p->m_attribute);
 
         // Visit the children
         p->visit_children(this);
 
         // Set type to type of looked up symbol
-        p->m_attribute.m_type=(AllType)*s;
+        if(s==NULL || s->baseType == bt_function) p->m_attribute.m_type.baseType=bt_undef;
+        else p->m_attribute.m_type=(AllType)*s;
     }
 
     //=====================================================================================================================